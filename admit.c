@@ -0,0 +1,319 @@
+#include <signal.h>
+#include <time.h>
+
+#include "admit.h"
+
+static AdmitLimits limits = {.order = ADMIT_FIFO};
+static Job *queue_first, *queue_last; // submission order, linked by queue_next
+static struct timespec last_admission;
+
+static const char *order_names[] = {"fifo", "priority"};
+
+/* measurements */
+
+static double elapsed_ms(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1e3 + (now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+static int n_stages(const Job *job)
+{
+    int n = 0;
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+        n++;
+    return n;
+}
+
+static double load_average()
+{
+    double load;
+    return getloadavg(&load, 1) == 1 ? load : 0.0;
+}
+
+// "some avg10" of the CPU pressure, in percent, or -1 without PSI.
+static double cpu_pressure()
+{
+    double avg10;
+    FILE *file = fopen(CPU_PRESSURE_FILEPATH, "r");
+    if (file == NULL)
+        return -1.0;
+
+    bool found = fscanf(file, "some avg10=%lf", &avg10) == 1;
+    fclose(file);
+    return found ? avg10 : -1.0;
+}
+
+/* queue */
+
+static Job *next_job()
+{
+    Job *best = queue_first;
+    if (limits.order == ADMIT_PRIORITY)
+    {
+        for (Job *cur_job = queue_first; cur_job != NULL; cur_job = cur_job->queue_next)
+        {
+            if (cur_job->priority > best->priority)
+                best = cur_job;
+        }
+    }
+    return best;
+}
+
+// The limit that keeps job from starting now, or NULL if it may start.
+static const char *blocking_limit(const Job *job)
+{
+    if (limits.max_jobs > 0 && running_back_jobs() >= limits.max_jobs)
+        return "jobs";
+
+    if (limits.max_procs > 0)
+    {
+        int procs = running_processes();
+        if (procs > 0 && procs + n_stages(job) > limits.max_procs)
+            return "processes";
+    }
+
+    if (limits.max_load > 0 || limits.max_pressure > 0)
+    {
+        if (elapsed_ms(&last_admission) < ADMIT_INTERVAL_MS)
+            return "pacing";
+        if (limits.max_load > 0 && load_average() >= limits.max_load)
+            return "load";
+        if (limits.max_pressure > 0 && cpu_pressure() >= limits.max_pressure)
+            return "pressure";
+    }
+    return NULL;
+}
+
+bool queue_job(Job *job)
+{
+    if (queue_first == NULL && blocking_limit(job) == NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &last_admission);
+        return false;
+    }
+
+    set_job_state(job, Pending);
+    job->queue_next = NULL;
+    if (queue_last != NULL)
+        queue_last->queue_next = job;
+    else
+        queue_first = job;
+    queue_last = job;
+
+    printf("[%d] Pending %s\n", job->id, job->line);
+    return true;
+}
+
+bool dequeue_job(Job *job)
+{
+    Job *prev = NULL;
+    for (Job *cur_job = queue_first; cur_job != NULL; prev = cur_job, cur_job = cur_job->queue_next)
+    {
+        if (cur_job != job)
+            continue;
+
+        if (prev != NULL)
+            prev->queue_next = job->queue_next;
+        else
+            queue_first = job->queue_next;
+        if (queue_last == job)
+            queue_last = prev;
+        job->queue_next = NULL;
+        return true;
+    }
+    return false;
+}
+
+bool can_admit()
+{
+    return queue_first != NULL && blocking_limit(next_job()) == NULL;
+}
+
+int admit_jobs()
+{
+    int n_admitted = 0;
+
+    while (can_admit())
+    {
+        Job *job = next_job();
+        dequeue_job(job);
+        clock_gettime(CLOCK_MONOTONIC, &last_admission);
+
+        run_job(job);
+        n_admitted++;
+        if (job->running_procs == 0) // none of its processes could be launched
+        {
+            finish_job(job);
+            continue;
+        }
+        set_job_state(job, Running);
+        printf("[%d] %d %s\n", job->id, job->pgid, job->line);
+    }
+    return n_admitted;
+}
+
+int admission_timeout()
+{
+    if (queue_first == NULL || (limits.max_load <= 0 && limits.max_pressure <= 0))
+        return -1; // only a process that terminates can make room
+    return ADMIT_INTERVAL_MS;
+}
+
+void drain_admission_queue()
+{
+    sigset_t mask, old_mask;
+    struct timespec interval = {ADMIT_INTERVAL_MS / 1000, (ADMIT_INTERVAL_MS % 1000) * 1000000};
+
+    // Blocked before the first reap, so that a child which exits in between still wakes sigtimedwait().
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+
+    while (queue_first != NULL)
+    {
+        wait_back_job();
+        admit_jobs();
+        free_jobs();
+        if (queue_first != NULL)
+            sigtimedwait(&mask, NULL, &interval);
+    }
+
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
+
+/* builtin command */
+
+static void print_limit(const char *name, double value, const char *format)
+{
+    printf("  %s ", name);
+    if (value > 0)
+        printf(format, value);
+    else
+        printf("none");
+}
+
+static void print_status()
+{
+    printf("limits\t");
+    print_limit("jobs", limits.max_jobs, "%.0f");
+    print_limit("processes", limits.max_procs, "%.0f");
+    print_limit("load", limits.max_load, "%.2f");
+    print_limit("pressure", limits.max_pressure, "%.2f%%");
+    printf("  order %s\n", order_names[limits.order]);
+
+    double pressure = cpu_pressure();
+    printf("running\t  jobs %d  processes %d  load %.2f", running_back_jobs(), running_processes(), load_average());
+    if (pressure >= 0)
+        printf("  pressure %.2f%%", pressure);
+    printf("\n");
+
+    int n_queued = 0;
+    for (Job *cur_job = queue_first; cur_job != NULL; cur_job = cur_job->queue_next)
+        n_queued++;
+    printf("queued\t  %d", n_queued);
+    if (queue_first != NULL)
+    {
+        const char *limit = blocking_limit(next_job());
+        printf(" (next held by: %s)", limit != NULL ? limit : "nothing");
+    }
+    printf("\n");
+
+    for (Job *cur_job = queue_first; cur_job != NULL; cur_job = cur_job->queue_next)
+        printf("  [%d] priority %d %s\n", cur_job->id, cur_job->priority, cur_job->line);
+}
+
+static bool drop_queued_job(int job_id)
+{
+    Job *job = find_job(job_id);
+    if (job == NULL || !dequeue_job(job))
+        return false;
+
+    set_job_state(job, Killed);
+    finish_job(job);
+    printf("[%d] Dropped %s\n", job->id, job->line);
+    return true;
+}
+
+void admit(Process *command)
+{
+    static const char usage[] = "admit -j 4 -p 32 -l 48 -s 20 -o priority` or `admit -P 5 make -j8 &";
+    char **args = command->args + 1;
+    AdmitLimits new_limits = limits;
+    int priority = 0;
+    bool valid = true;
+    size_t i;
+
+    if (args[0] == NULL)
+    {
+        print_status();
+        return;
+    }
+
+    for (i = 0; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0' && args[i][2] == '\0'; i++)
+    {
+        char option = args[i][1], *value = args[i + 1];
+        if (value == NULL || strchr("jplsoPd", option) == NULL)
+        {
+            valid = false;
+            break;
+        }
+
+        switch (option)
+        {
+        case 'j':
+            valid = (new_limits.max_jobs = atoi(value)) >= 0;
+            break;
+        case 'p':
+            valid = (new_limits.max_procs = atoi(value)) >= 0;
+            break;
+        case 'l':
+            valid = (new_limits.max_load = atof(value)) >= 0;
+            break;
+        case 's':
+            valid = (new_limits.max_pressure = atof(value)) >= 0;
+            if (new_limits.max_pressure > 0 && cpu_pressure() < 0)
+                printf("-shellman: admit: no PSI (%s): the pressure limit is ignored\n", CPU_PRESSURE_FILEPATH);
+            break;
+        case 'o':
+            new_limits.order = strcmp(value, "priority") == 0 ? ADMIT_PRIORITY : ADMIT_FIFO;
+            valid = new_limits.order == ADMIT_PRIORITY || strcmp(value, "fifo") == 0;
+            break;
+        case 'P':
+            priority = atoi(value);
+            break;
+        case 'd':
+            if (!drop_queued_job(atoi(value)))
+                printf("-shellman: admit: no queued job: %s\n", value);
+            break;
+        }
+        if (!valid)
+            break;
+        i++;
+    }
+
+    if (!valid || (args[i] != NULL && args[i][0] == '-'))
+    {
+        printf("-shellman: admit example usage: `%s`\n", usage);
+        return;
+    }
+    limits = new_limits;
+
+    if (args[i] == NULL)
+    {
+        admit_jobs(); // the limits may have been raised
+        return;
+    }
+
+    size_t line_offset;
+    Job *job = copy_rest_of_line(command->job, i + 1, &line_offset);
+    if (job == NULL)
+    {
+        perror("-shellman: admit: new_job");
+        return;
+    }
+    job->line += line_offset; // just the pipeline, for `jobs` and notices
+    job->priority = priority;
+    launch_job(job);
+}
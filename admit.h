@@ -0,0 +1,77 @@
+#ifndef admit_h
+#define admit_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+
+#define ADMIT_INTERVAL_MS 1000 // pacing of admissions, and how often the loop rechecks, under a load limit
+#define CPU_PRESSURE_FILEPATH "/proc/pressure/cpu"
+
+/**
+ *
+ * Admission queue of background jobs.
+ *
+ * A job that ends with '&' is launched at once only if no job is queued and
+ * the limits set by `admit` allow it. Otherwise it stays Pending in the job
+ * list, and admit_jobs() launches queued jobs one by one, as long as the limits
+ * allow, whenever a process is reaped and every ADMIT_INTERVAL_MS while the
+ * shell waits at the prompt. A script waits for its queue to empty before the
+ * shell exits.
+ *
+ * Limits (0: none):
+ *
+ *   -j N     running background jobs
+ *   -p N     running processes over all jobs; a job larger than N is admitted
+ *            once nothing else is running
+ *   -l LOAD  1-minute load average
+ *   -s PCT   CPU pressure: "some avg10" of /proc/pressure/cpu (PSI), in percent
+ *
+ * Load and pressure lag behind the jobs that cause them, so under either limit
+ * at most one job is admitted per ADMIT_INTERVAL_MS: a burst of submissions
+ * cannot all slip in before the numbers move.
+ *
+ * -o fifo admits in submission order, -o priority the highest priority first
+ * (FIFO among equals). `admit -P PRIO CMD ... &` submits a job with a priority;
+ * typed jobs have priority 0. `fg ID` and `bg ID` launch a queued job at once,
+ * whatever the limits; `admit -d ID` drops it.
+ *
+ * `admit` without arguments shows the limits, what is running and the queue.
+ *
+**/
+typedef enum admitorder
+{
+    ADMIT_FIFO,
+    ADMIT_PRIORITY
+} AdmitOrder;
+
+typedef struct admitlimits
+{
+    int max_jobs;
+    int max_procs;
+    double max_load;
+    double max_pressure;
+    AdmitOrder order;
+} AdmitLimits;
+
+// Queue a background job that was just inserted into the job list, unless it may start at once.
+// Return true if it was queued: it is Pending until admit_jobs() launches it.
+bool queue_job(Job *job);
+// Take a queued job out of the queue, e.g. to launch it in the foreground. Return false if it was not queued.
+bool dequeue_job(Job *job);
+// A queued job may be launched now.
+bool can_admit();
+// Launch queued jobs while the limits allow. Return the number launched.
+int admit_jobs();
+// Milliseconds the event loop may sleep before admit_jobs() has to run again: -1 if only a reap can help.
+int admission_timeout();
+// Reap and admit until no job is left in the queue: the end of a script.
+void drain_admission_queue();
+
+void admit(Process *command);
+
+#endif
@@ -0,0 +1,90 @@
+#include "arena.h"
+
+#define ALIGN_UP(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define CHUNK_HEADER_SIZE ALIGN_UP(sizeof(ArenaChunk))
+#define CHUNK_DATA(chunk) ((char *)(chunk) + CHUNK_HEADER_SIZE)
+
+static size_t bytes_in_use = 0; // over all arenas
+
+static void free_chunk(ArenaChunk *chunk)
+{
+    bytes_in_use -= CHUNK_HEADER_SIZE + chunk->capacity;
+    free(chunk);
+}
+
+static ArenaChunk *new_chunk(size_t capacity)
+{
+    ArenaChunk *chunk = (ArenaChunk *)malloc(CHUNK_HEADER_SIZE + capacity);
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->next = NULL;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    bytes_in_use += CHUNK_HEADER_SIZE + capacity;
+    return chunk;
+}
+
+Arena *new_arena(size_t chunk_size)
+{
+    chunk_size = ALIGN_UP(chunk_size + sizeof(Arena));
+
+    ArenaChunk *chunk = new_chunk(chunk_size);
+    if (chunk == NULL)
+        return NULL;
+
+    Arena *arena = (Arena *)CHUNK_DATA(chunk);
+    chunk->used = ALIGN_UP(sizeof(Arena));
+
+    arena->chunks = chunk;
+    arena->first = chunk;
+    arena->chunk_size = chunk_size;
+    return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk = arena->chunks;
+    size = ALIGN_UP(size);
+
+    if (chunk->capacity - chunk->used < size)
+    {
+        if ((chunk = new_chunk(size > arena->chunk_size ? size : arena->chunk_size)) == NULL)
+            return NULL;
+
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    void *ptr = CHUNK_DATA(chunk) + chunk->used;
+    chunk->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void reset_arena(Arena *arena)
+{
+    ArenaChunk *cur_chunk, *next_chunk;
+    for (cur_chunk = arena->chunks; cur_chunk != arena->first; cur_chunk = next_chunk)
+    {
+        next_chunk = cur_chunk->next;
+        free_chunk(cur_chunk);
+    }
+
+    arena->chunks = arena->first;
+    arena->first->used = ALIGN_UP(sizeof(Arena));
+}
+
+void free_arena(Arena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    reset_arena(arena);
+    free_chunk(arena->first); // the arena itself lives in this chunk
+}
+
+size_t arena_bytes()
+{
+    return bytes_in_use;
+}
@@ -0,0 +1,43 @@
+#ifndef arena_h
+#define arena_h
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_CHUNK_SIZE 4096
+
+/**
+ *
+ * Bump allocator. Memory is handed out from large chunks and released all at once
+ * by reset_arena() or free_arena(); there is no per-object free.
+ * The Arena itself lives at the beginning of its first chunk, so an arena that fits
+ * in one chunk costs exactly one malloc() and one free().
+ *
+**/
+typedef struct arenachunk
+{
+    struct arenachunk *next;
+    size_t capacity; // usable bytes after the header
+    size_t used;
+} ArenaChunk;
+
+typedef struct arena
+{
+    ArenaChunk *chunks; // the chunk currently allocated from, followed by the older ones
+    ArenaChunk *first;  // the chunk holding this Arena
+    size_t chunk_size;
+} Arena;
+
+// chunk_size is the capacity of the first chunk and the minimum capacity of the others
+Arena *new_arena(size_t chunk_size);
+// Return zero-filled memory aligned to ARENA_ALIGNMENT, or NULL if out of memory.
+void *arena_alloc(Arena *arena, size_t size);
+// Release everything allocated so far but keep the first chunk for reuse.
+void reset_arena(Arena *arena);
+void free_arena(Arena *arena);
+// Bytes of the chunks of all arenas, headers included.
+size_t arena_bytes();
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef bench_h
+#define bench_h
+
+#include <stdio.h>
+#include <time.h>
+
+/**
+ *
+ * Shared helpers of the benchmarks under bench/.
+ *
+ * Every result is one tab-separated row "bench case metric value unit" on stdout,
+ * so that the output of `make bench` is a single table that can be diffed or
+ * joined between two versions (`make bench > before.tsv`). Columns, case names
+ * and units are part of that interface: add rows rather than changing them.
+ *
+**/
+
+#define BENCH_COLUMNS "bench\tcase\tmetric\tvalue\tunit"
+
+static inline double bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void bench_row(const char *bench, const char *bench_case, const char *metric, double value,
+                             const char *unit)
+{
+    printf("%s\t%s\t%s\t%.3f\t%s\n", bench, bench_case, metric, value, unit);
+    fflush(stdout);
+}
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ *
+ * Job bookkeeping with many live background jobs: pid -> process lookup (what
+ * wait_back_job() does per reaped child), job id lookup (fg/bg) and insert/delete
+ * churn, against the linear walk over shell->jobs that these used to do.
+ *
+**/
+#include "bench.h"
+#include "../job.h"
+
+Shell *shell;
+
+#define PROCS_PER_JOB 3
+#define FAKE_PID_BASE 4000000 // never a real child of this process
+
+static Job *make_job(pid_t *next_pid)
+{
+    Job *job = new_job(32);
+    Process *process = job->process_queue;
+
+    for (int i = 0; i < PROCS_PER_JOB; i++)
+    {
+        if (i > 0)
+            process = new_process(job->arena, process);
+        process->pid = (*next_pid)++;
+        process->job = job;
+    }
+
+    insert_job(job);
+    for (process = job->process_queue; process != NULL; process = process->next)
+        register_process(process);
+    set_job_state(job, Running);
+    return job;
+}
+
+static Process *linear_find_process(pid_t pid)
+{
+    for (Job *cur_job = shell->jobs; cur_job != NULL; cur_job = cur_job->next)
+        for (Process *cur_proc = cur_job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+            if (cur_proc->pid == pid)
+                return cur_proc;
+    return NULL;
+}
+
+int main()
+{
+    static const int n_jobs_list[] = {10, 100, 1000, 10000, 100000};
+    static const int n_ops = 200000;
+
+    shell = (Shell *)calloc(1, sizeof(Shell));
+    srand(1);
+
+    for (size_t n = 0; n < sizeof(n_jobs_list) / sizeof(int); n++)
+    {
+        int n_jobs = n_jobs_list[n];
+        pid_t next_pid = FAKE_PID_BASE;
+        Job **live = (Job **)malloc(n_jobs * sizeof(Job *));
+        volatile size_t sink = 0;
+
+        for (int i = 0; i < n_jobs; i++)
+            live[i] = make_job(&next_pid);
+
+        double start = bench_now();
+        for (int i = 0; i < n_ops; i++)
+        {
+            Process *process = live[rand() % n_jobs]->process_queue->next;
+            sink += find_process(process->pid) == process;
+        }
+        double pid_ns = (bench_now() - start) / n_ops * 1e9;
+
+        start = bench_now();
+        for (int i = 0; i < n_ops; i++)
+        {
+            Job *job = live[rand() % n_jobs];
+            sink += find_job(job->id) == job;
+        }
+        double jobid_ns = (bench_now() - start) / n_ops * 1e9;
+
+        // delete a random job as if its last process was reaped, and start a new one in its place
+        start = bench_now();
+        for (int i = 0; i < n_ops; i++)
+        {
+            int victim = rand() % n_jobs;
+            finish_job(live[victim]);
+            free_jobs();
+            live[victim] = make_job(&next_pid);
+        }
+        double churn_ns = (bench_now() - start) / n_ops * 1e9;
+
+        int n_linear = n_ops / n_jobs + 10;
+        start = bench_now();
+        for (int i = 0; i < n_linear; i++)
+        {
+            Process *process = live[rand() % n_jobs]->process_queue->next;
+            sink += linear_find_process(process->pid) == process;
+        }
+        double linear_ns = (bench_now() - start) / n_linear * 1e9;
+
+        if (sink != (size_t)(2 * n_ops + n_linear))
+        {
+            printf("bench_jobs: lookup returned a wrong entry\n");
+            return 1;
+        }
+
+        char bench_case[32];
+        snprintf(bench_case, sizeof(bench_case), "jobs=%d", n_jobs);
+        bench_row("jobs", bench_case, "find_process", pid_ns, "ns/op");
+        bench_row("jobs", bench_case, "find_job", jobid_ns, "ns/op");
+        bench_row("jobs", bench_case, "churn", churn_ns, "ns/op");
+        bench_row("jobs", bench_case, "linear_find_process", linear_ns, "ns/op");
+
+        for (int i = 0; i < n_jobs; i++)
+            finish_job(live[i]);
+        free_jobs();
+        free(live);
+    }
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ *
+ * The command lifecycle piece by piece, as a regression suite:
+ *
+ * - parse:    tokenize_string() + new_job() + parse() of synthetic lines of
+ *             increasing length and pipe count, in lines/s and MB/s, against
+ *             cached_job(), i.e. a parse cache hit
+ * - churn:    new_job() -> insert_job() -> finish_job() -> free_jobs() of jobs
+ *             sized for lines of increasing length
+ * - pipeline: eval_line() of "true | true | ..." with 1 to 8 stages, i.e.
+ *             fork -> exec -> reap of every stage, for each spawn backend
+ *
+**/
+#include "bench.h"
+#include "../job.h"
+#include "../parser.h"
+#include "../parsecache.h"
+#include "../shell.h"
+
+Shell *shell;
+
+#define ARGS_PER_STAGE 6
+
+// "cmd aaa aaa ... | cmd aaa aaa ..." of n_stages stages and about line_len bytes
+static char *make_line(size_t line_len, int n_stages)
+{
+    size_t stage_len = line_len / n_stages;
+    size_t arg_len = stage_len > 4 + 2 * ARGS_PER_STAGE ? (stage_len - 4) / ARGS_PER_STAGE - 1 : 1;
+    char *line = (char *)malloc(n_stages * (8 + ARGS_PER_STAGE * (arg_len + 1)) + 1);
+    char *cur = line;
+
+    for (int s = 0; s < n_stages; s++)
+    {
+        if (s > 0)
+            cur += sprintf(cur, " | ");
+        cur += sprintf(cur, "cmd");
+        for (int a = 0; a < ARGS_PER_STAGE; a++)
+        {
+            *cur++ = ' ';
+            memset(cur, 'a' + a, arg_len);
+            cur += arg_len;
+        }
+    }
+    *cur = '\0';
+    return line;
+}
+
+static void bench_parse(Arena *line_arena)
+{
+    static const size_t line_lens[] = {16, 64, 256, 1024, 4096};
+    static const int pipe_counts[] = {0, 1, 3, 7};
+
+    for (size_t l = 0; l < sizeof(line_lens) / sizeof(size_t); l++)
+    {
+        for (size_t p = 0; p < sizeof(pipe_counts) / sizeof(int); p++)
+        {
+            char *line = make_line(line_lens[l], pipe_counts[p] + 1);
+            size_t len = strlen(line);
+            int iterations = (int)(50000000 / (len + 256));
+
+            double start = bench_now();
+            for (int i = 0; i < iterations; i++)
+            {
+                Token *tokens = new_token(line_arena, NULL);
+                size_t line_size = tokenize_string(line_arena, tokens, line, len);
+                Job *job = new_job(line_size);
+                if (parse(job, tokens) == -1)
+                {
+                    printf("bench_lifecycle: parse failed: %s\n", line);
+                    exit(1);
+                }
+                free_job(job);
+                reset_arena(line_arena);
+            }
+            double elapsed = bench_now() - start;
+
+            char bench_case[32];
+            snprintf(bench_case, sizeof(bench_case), "len=%zu,pipes=%d", line_lens[l], pipe_counts[p]);
+            bench_row("parse", bench_case, "latency", elapsed / iterations * 1e9, "ns/line");
+            bench_row("parse", bench_case, "throughput", len * iterations / elapsed / 1e6, "MB/s");
+
+            Token *tokens = new_token(line_arena, NULL);
+            Job *parsed = new_job(tokenize_string(line_arena, tokens, line, len));
+            parse(parsed, tokens);
+            cache_job(line, len, parsed);
+            free_job(parsed);
+            reset_arena(line_arena);
+
+            start = bench_now();
+            for (int i = 0; i < iterations; i++)
+                free_job(cached_job(line, len));
+            elapsed = bench_now() - start;
+            bench_row("parse", bench_case, "cached", elapsed / iterations * 1e9, "ns/line");
+            free(line);
+        }
+    }
+}
+
+static void bench_churn()
+{
+    static const size_t line_sizes[] = {16, 256, 4096, 65536};
+    static const int iterations = 200000;
+
+    for (size_t l = 0; l < sizeof(line_sizes) / sizeof(size_t); l++)
+    {
+        double start = bench_now();
+        for (int i = 0; i < iterations; i++)
+        {
+            Job *job = new_job(line_sizes[l]);
+            insert_job(job);
+            finish_job(job);
+            free_jobs();
+        }
+        double elapsed = bench_now() - start;
+
+        char bench_case[32];
+        snprintf(bench_case, sizeof(bench_case), "line_size=%zu", line_sizes[l]);
+        bench_row("churn", bench_case, "new_free", elapsed / iterations * 1e9, "ns/op");
+    }
+}
+
+static void bench_pipeline(Arena *line_arena)
+{
+    static const char *modes[] = {"fork", "posix_spawn", "forkserver"};
+    static const int iterations = 100;
+
+    for (size_t m = 0; m < sizeof(modes) / sizeof(char *); m++)
+    {
+        set_spawn_mode(modes[m]);
+
+        for (int n_stages = 1; n_stages <= 8; n_stages++)
+        {
+            char line[128] = "true";
+            for (int s = 1; s < n_stages; s++)
+                strcat(line, " | true");
+            size_t len = strlen(line);
+
+            double start = bench_now();
+            for (int i = 0; i < iterations; i++)
+            {
+                Token *tokens = new_token(line_arena, NULL);
+                size_t line_size = tokenize_string(line_arena, tokens, line, len);
+                eval_line(tokens, line_size);
+                reset_arena(line_arena);
+            }
+            double elapsed = bench_now() - start;
+
+            char bench_case[32];
+            snprintf(bench_case, sizeof(bench_case), "stages=%d", n_stages);
+            bench_row("pipeline", bench_case, modes[m], elapsed / iterations * 1e6, "us/line");
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    fork_server_main(argc, argv);
+
+    shell = (Shell *)calloc(1, sizeof(Shell));
+    shell->line_arena = new_arena(ARENA_CHUNK_SIZE);
+
+    bench_parse(shell->line_arena);
+    bench_churn();
+    bench_pipeline(shell->line_arena);
+
+    free_arena(shell->line_arena);
+    return 0;
+}
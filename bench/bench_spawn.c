@@ -0,0 +1,95 @@
+/**
+ *
+ * Launch latency of the spawn backends (spawn -> exec -> reap of /bin/true)
+ * while the shell holds an increasing amount of touched memory, and the cost of
+ * a path cache hit on a command in the last of several PATH directories: in a
+ * new line (the directories in front are stat()ed), and again in the same line.
+ *
+**/
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "../job.h"
+#include "../spawn.h"
+
+Shell *shell;
+
+static double bench_launch(const char *mode, int iterations)
+{
+    Process process;
+    memset(&process, 0, sizeof(process));
+    process.cmd = "true";
+    push_arg(NULL, &process, process.cmd); // fits in the inline slots: no arena needed
+    set_spawn_mode(mode);
+
+    double start = bench_now();
+    for (int i = 0; i < iterations; i++)
+    {
+        pid_t pid = spawn_process(&process, "/bin/true", 0);
+        if (pid == -1 || waitpid(pid, NULL, 0) == -1)
+        {
+            printf("bench_spawn: %s failed\n", mode);
+            exit(1);
+        }
+    }
+    return (bench_now() - start) / iterations;
+}
+
+// Mean ns of resolve_command() on a cached command, a new line before every lookup or not.
+static double bench_resolve(const char *cmd, bool new_lines, int iterations)
+{
+    resolve_command(cmd); // fill the cache
+
+    double start = bench_now();
+    for (int i = 0; i < iterations; i++)
+    {
+        if (new_lines)
+            new_path_generation();
+        if (resolve_command(cmd) == NULL)
+        {
+            printf("bench_spawn: %s not found\n", cmd);
+            exit(1);
+        }
+    }
+    return (bench_now() - start) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    fork_server_main(argc, argv);
+
+    static const size_t ballast_mib[] = {0, 64, 256, 1024};
+    static const int iterations = 300;
+    char *ballast = NULL;
+
+    shell = (Shell *)calloc(1, sizeof(Shell));
+
+    for (size_t i = 0; i < sizeof(ballast_mib) / sizeof(size_t); i++)
+    {
+        size_t size = ballast_mib[i] << 20;
+        if (size > 0)
+        {
+            free(ballast);
+            if ((ballast = (char *)malloc(size)) == NULL)
+                break;
+            memset(ballast, 1, size); // touch every page so that fork() has to copy its page tables
+        }
+
+        double fork_latency = bench_launch("fork", iterations);
+        double spawn_latency = bench_launch("posix_spawn", iterations);
+        double server_latency = bench_launch("forkserver", iterations);
+
+        char bench_case[32];
+        snprintf(bench_case, sizeof(bench_case), "rss_mib=%zu", ballast_mib[i]);
+        bench_row("spawn", bench_case, "fork", fork_latency * 1e6, "us/launch");
+        bench_row("spawn", bench_case, "posix_spawn", spawn_latency * 1e6, "us/launch");
+        bench_row("spawn", bench_case, "forkserver", server_latency * 1e6, "us/launch");
+    }
+
+    free(ballast);
+
+    setenv("PATH", "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin", 1);
+    bench_row("spawn", "resolve dirs=6", "new_line", bench_resolve("true", true, 100000) * 1e9, "ns/lookup");
+    bench_row("spawn", "resolve dirs=6", "same_line", bench_resolve("true", false, 100000) * 1e9, "ns/lookup");
+    return 0;
+}
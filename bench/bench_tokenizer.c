@@ -0,0 +1,197 @@
+/**
+ *
+ * Tokenize+parse throughput on long lines: the slice-based tokenizer (with each
+ * available delimiter scanner) against the previous per-character tokenizer,
+ * which called strlen() per appended character and copied every token three times.
+ *
+**/
+#include "bench.h"
+#include "../job.h"
+#include "../parser.h"
+
+Shell *shell;
+
+/* previous implementation, kept here as the baseline */
+
+typedef struct legacy_token
+{
+    TokenLabel label;
+    struct legacy_token *prev;
+    struct legacy_token *next;
+    char *string;
+    int size;
+} LegacyToken;
+
+static LegacyToken *legacy_new_token(LegacyToken *cur_token)
+{
+    LegacyToken *new_token = (LegacyToken *)calloc(1, sizeof(LegacyToken));
+    cur_token->next = new_token;
+    new_token->prev = cur_token;
+    return new_token;
+}
+
+static size_t legacy_tokenize(LegacyToken *token, char *buffer)
+{
+    if (token->prev == NULL || token->prev->label == PIPE)
+        token->label = CMD;
+    else if (strcmp(buffer, "|") == 0)
+        token->label = PIPE;
+    else
+        token->label = ARG;
+
+    size_t token_size = (strlen(buffer) + 1) * sizeof(char);
+    token->string = (char *)malloc(token_size);
+    strcpy(token->string, buffer);
+    token->size = token_size;
+    return token_size + 1;
+}
+
+static size_t legacy_tokenize_line(LegacyToken *token, const char *line)
+{
+    char buffer[MAX_BUFFER_SIZE];
+    memset(buffer, '\0', sizeof(buffer));
+    size_t line_size = 0;
+
+    for (const char *cur = line;; cur++) // getchar() replaced by a memory cursor
+    {
+        int c = *cur;
+        if (c == ' ' || c == '\n')
+        {
+            if (strlen(buffer) > 0)
+            {
+                line_size += legacy_tokenize(token, buffer);
+                token = legacy_new_token(token);
+                memset(buffer, '\0', sizeof(buffer));
+            }
+            if (c == '\n')
+                break;
+        }
+        else
+        {
+            buffer[strlen(buffer)] = c;
+        }
+    }
+    token->label = NONE;
+    return line_size;
+}
+
+static void legacy_parse_and_free(LegacyToken *head, size_t line_size)
+{
+    char *line = (char *)calloc(line_size, sizeof(char));
+    LegacyToken *cur_token, *next_token;
+
+    for (cur_token = head; cur_token->label != NONE; cur_token = cur_token->next)
+    {
+        char *copy = (char *)malloc(cur_token->size); // copy_token_string()
+        strcpy(copy, cur_token->string);
+        free(copy);
+
+        strcat(line, cur_token->string);
+        if (cur_token->next->label != NONE)
+            strcat(line, " ");
+    }
+    free(line);
+
+    for (cur_token = head; cur_token != NULL; cur_token = next_token)
+    {
+        next_token = cur_token->next;
+        free(cur_token->string);
+        free(cur_token);
+    }
+}
+
+/* benchmark */
+
+// "/bin/stage a1 b2 c3 | /bin/stage a1 b2 c3 | ..." of about line_len bytes, '\n'-terminated
+static char *make_line(size_t line_len)
+{
+    static const char stage[] = "/usr/local/bin/stage --alpha=1 --beta=22 input.txt | ";
+    char *line = (char *)malloc(line_len + sizeof(stage) + 1);
+    size_t len = 0;
+
+    while (len < line_len)
+    {
+        memcpy(line + len, stage, sizeof(stage) - 1);
+        len += sizeof(stage) - 1;
+    }
+    memcpy(line + len - 3, "\n", 2); // drop the trailing " | "
+    return line;
+}
+
+static double bench_legacy(const char *line, int iterations)
+{
+    double start = bench_now();
+    for (int i = 0; i < iterations; i++)
+    {
+        LegacyToken *tokens = (LegacyToken *)calloc(1, sizeof(LegacyToken));
+        size_t line_size = legacy_tokenize_line(tokens, line);
+        legacy_parse_and_free(tokens, line_size);
+    }
+    return (bench_now() - start) / iterations;
+}
+
+static double bench_current(const char *line, size_t line_len, int iterations)
+{
+    double start = bench_now();
+    Arena *line_arena = new_arena(ARENA_CHUNK_SIZE);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        Token *tokens = new_token(line_arena, NULL);
+        size_t line_size = tokenize_string(line_arena, tokens, line, line_len);
+        Job *job = new_job(line_size);
+        if (parse(job, tokens) == -1)
+        {
+            printf("bench_tokenizer: parse failed\n");
+            exit(1);
+        }
+        insert_finished_job(job);
+        free_jobs();
+        reset_arena(line_arena);
+    }
+    free_arena(line_arena);
+    return (bench_now() - start) / iterations;
+}
+
+int main()
+{
+    static const size_t line_lens[] = {64, 256, 1024, 4096, 16384, 65536};
+    static const char *backends[] = {"scalar", "sse2", "avx2"};
+
+    shell = (Shell *)calloc(1, sizeof(Shell));
+
+    for (size_t i = 0; i < sizeof(line_lens) / sizeof(size_t); i++)
+    {
+        char *line = make_line(line_lens[i]);
+        size_t len = strlen(line) - 1;
+        int iterations = (int)(20000000 / (len * 16)) + 1;
+        size_t n_tokens = 0;
+
+        for (const char *c = line; *c != '\n'; c++)
+            n_tokens += (*c == ' ');
+
+        char bench_case[32];
+        snprintf(bench_case, sizeof(bench_case), "len=%zu", len);
+        bench_row("tokenizer", bench_case, "tokens", n_tokens + 1, "count");
+
+        double legacy = bench_legacy(line, iterations);
+        double best = legacy;
+        bench_row("tokenizer", bench_case, "legacy", legacy * 1e9, "ns/line");
+
+        for (size_t b = 0; b < sizeof(backends) / sizeof(char *); b++)
+        {
+            if (!set_tokenizer_backend(backends[b]))
+                continue; // not supported by this CPU
+
+            double current = bench_current(line, len, iterations);
+            if (current < best)
+                best = current;
+            bench_row("tokenizer", bench_case, backends[b], current * 1e9, "ns/line");
+        }
+
+        bench_row("tokenizer", bench_case, "speedup", legacy / best, "x");
+        free(line);
+    }
+
+    return 0;
+}
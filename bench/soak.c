@@ -0,0 +1,204 @@
+/**
+ *
+ * Soak test of the job lifecycle: `make soak` (SOAK_COMMANDS=1000000 by default).
+ *
+ * Runs the shell on a script of mixed lines (builtins, pipelines, parse errors,
+ * commands not found, here-documents, background jobs) and samples, while it
+ * runs, the anonymous RSS of the shell (/proc/PID/status) and the heap and
+ * arena bytes of its metrics page (stats.h). Memory must be flat once the
+ * caches have filled: the growth from the sample at WARMUP_FRACTION of the
+ * commands to the last sample must stay under the limits below, or the test
+ * fails. Results are rows of the bench table (bench.h).
+ *
+ *   bench/soak SHELL [N_COMMANDS]
+ *
+**/
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../stats.h"
+
+#define WARMUP_FRACTION 0.1
+#define MAX_RSS_GROWTH_KIB 1024
+#define MAX_HEAP_GROWTH_BYTES (256 * 1024)
+#define SAMPLE_INTERVAL_MS 100
+
+typedef struct sample
+{
+    uint64_t commands;
+    long rss_kib;
+    uint64_t heap_bytes;
+    uint64_t arena_bytes;
+} Sample;
+
+// Line i of the script: mostly lines that cost the shell alone, one in ten forks.
+static void write_line(FILE *script, long i)
+{
+    static const char *builtin_lines[] = {"jobs", "spawn", "parsecache", "admit", "shellstat", "time jobs", "jobs &"};
+    static const char *error_lines[] = {"echo soak |", "cat <", "true & true", "cat <<<", "time"};
+
+    switch (i % 10)
+    {
+    case 0:
+        if (i % 100 == 0)
+            fprintf(script, "true &\n");
+        else if (i % 50 == 10)
+            fprintf(script, "cat <<EOF\nline %ld\nEOF\n", i);
+        else if (i % 30 == 20)
+            fprintf(script, "cat <<< %ld\n", i);
+        else
+            fprintf(script, "echo %ld | cat > /dev/null\n", i);
+        break;
+    case 1:
+    case 2:
+    case 3:
+        fprintf(script, "%s\n", builtin_lines[i % (sizeof(builtin_lines) / sizeof(char *))]);
+        break;
+    case 4:
+    case 5:
+        fprintf(script, "%s\n", error_lines[i % (sizeof(error_lines) / sizeof(char *))]);
+        break;
+    case 6:
+        fprintf(script, "soak_missing_%ld arg\n", i % 10000); // unique enough to churn the path and parse caches
+        break;
+    default:
+        fprintf(script, "admit -j 0 -p 0\n");
+        break;
+    }
+}
+
+static long anon_rss_kib(pid_t pid)
+{
+    char filepath[64], line[256];
+    long kib = -1;
+
+    snprintf(filepath, sizeof(filepath), "/proc/%d/status", pid);
+    FILE *file = fopen(filepath, "r");
+    if (file == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (sscanf(line, "RssAnon: %ld kB", &kib) == 1)
+            break;
+    }
+    fclose(file);
+    return kib;
+}
+
+static const ShellStats *map_stats(pid_t pid)
+{
+    char filepath[512];
+    const char *dir = getenv("SHELLMAN_STATS");
+    snprintf(filepath, sizeof(filepath), STATS_FILE_FORMAT, dir != NULL ? dir : STATS_DIR, pid);
+
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    void *page = mmap(NULL, sizeof(ShellStats), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return page == MAP_FAILED ? NULL : (const ShellStats *)page;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s SHELL [N_COMMANDS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    long n_commands = argc > 2 ? atol(argv[2]) : 1000000;
+
+    char script_path[] = "/tmp/shellman-soak-XXXXXX";
+    int script_fd = mkstemp(script_path);
+    FILE *script = script_fd != -1 ? fdopen(script_fd, "w") : NULL;
+    if (script == NULL)
+    {
+        perror("soak: script");
+        return EXIT_FAILURE;
+    }
+    for (long i = 0; i < n_commands; i++)
+        write_line(script, i);
+    fclose(script);
+
+    const char *stats_dir = getenv("SHELLMAN_STATS");
+    if (stats_dir != NULL && strcmp(stats_dir, "off") == 0)
+        unsetenv("SHELLMAN_STATS"); // the page is what is measured
+
+    double start = bench_now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int null_fd = open("/dev/null", O_RDWR);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(argv[1], argv[1], script_path, (char *)NULL);
+        _exit(127);
+    }
+
+    Sample *samples = (Sample *)calloc(1, sizeof(Sample));
+    size_t n_samples = 0, capacity = 1;
+    const ShellStats *page = NULL;
+    struct timespec interval = {0, SAMPLE_INTERVAL_MS * 1000000L};
+    int status;
+
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+        nanosleep(&interval, NULL);
+        if (page == NULL && (page = map_stats(pid)) == NULL)
+            continue;
+
+        Sample sample;
+        ShellStats stats;
+        if ((sample.rss_kib = anon_rss_kib(pid)) == -1 || !read_stats(page, &stats))
+            continue;
+        sample.commands = stats.commands;
+        sample.heap_bytes = stats.heap_bytes;
+        sample.arena_bytes = stats.arena_bytes;
+
+        if (n_samples == capacity)
+            samples = (Sample *)realloc(samples, (capacity *= 2) * sizeof(Sample));
+        samples[n_samples++] = sample;
+    }
+    double elapsed = bench_now() - start;
+    unlink(script_path);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || n_samples < 2)
+    {
+        fprintf(stderr, "soak: the shell failed, or ran too briefly to sample (status %d, %zu samples)\n", status,
+                n_samples);
+        return EXIT_FAILURE;
+    }
+
+    const Sample *warm = &samples[0], *last = &samples[n_samples - 1];
+    for (size_t i = 0; i < n_samples && samples[i].commands < WARMUP_FRACTION * n_commands; i++)
+        warm = &samples[i + 1 < n_samples ? i + 1 : i];
+
+    long rss_growth = last->rss_kib - warm->rss_kib;
+    long heap_growth = (long)last->heap_bytes - (long)warm->heap_bytes;
+
+    printf("%s\n", BENCH_COLUMNS);
+    bench_row("soak", "mixed", "commands", last->commands, "count");
+    bench_row("soak", "mixed", "throughput", last->commands / elapsed, "commands/s");
+    bench_row("soak", "mixed", "rss_warm", warm->rss_kib, "KiB");
+    bench_row("soak", "mixed", "rss_last", last->rss_kib, "KiB");
+    bench_row("soak", "mixed", "rss_growth", rss_growth, "KiB");
+    bench_row("soak", "mixed", "heap_warm", warm->heap_bytes, "bytes");
+    bench_row("soak", "mixed", "heap_last", last->heap_bytes, "bytes");
+    bench_row("soak", "mixed", "heap_growth", heap_growth, "bytes");
+    bench_row("soak", "mixed", "arena_last", last->arena_bytes, "bytes");
+
+    if (rss_growth > MAX_RSS_GROWTH_KIB || heap_growth > MAX_HEAP_GROWTH_BYTES)
+    {
+        fprintf(stderr, "soak: FAILED: memory grew by %ld KiB of RSS and %ld bytes of heap after warm-up\n",
+                rss_growth, heap_growth);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "soak: ok: memory flat over %llu commands\n", (unsigned long long)last->commands);
+    return EXIT_SUCCESS;
+}
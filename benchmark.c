@@ -0,0 +1,319 @@
+#include <math.h>
+
+#include "benchmark.h"
+#include "job.h"
+
+// A process of the run was killed from the keyboard or by kill(1): the user wants out.
+static bool interrupted(Job *job)
+{
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+    {
+        if (cur_proc->pid == 0 || !WIFSIGNALED(cur_proc->status))
+            continue;
+        int sig = WTERMSIG(cur_proc->status);
+        if (sig == SIGINT || sig == SIGQUIT || sig == SIGTERM || sig == SIGKILL)
+            return true;
+    }
+    return false;
+}
+
+// Launch a copy of the template and wait for it. Return false if the benchmark has to stop.
+static bool run_once(const Job *template, size_t line_offset, BenchRun *run)
+{
+    Job *job = copy_job(template);
+    if (job == NULL)
+    {
+        perror("-shellman: bench: new_job");
+        return false;
+    }
+    job->line += line_offset; // just the pipeline, for `jobs` and notices
+    job->no_history = true;
+
+    insert_job(job);
+    run_job(job);
+    if (job->running_procs == 0) // nothing could be launched
+    {
+        finish_job(job);
+        free_jobs();
+        return false;
+    }
+
+    set_job_state(job, Running);
+    wait_fore_job(job);
+    if (shell->interactive && tcsetpgrp(STDIN_FILENO, getpgid((pid_t)0)) == -1)
+        perror("tcsetpgrp");
+
+    if (job->job_state == Stopped)
+        return false; // stays in the job list for fg
+
+    bool completed = !interrupted(job);
+    run->wall = wall_seconds(&job->usage);
+    run->user = job->usage.utime.tv_sec + job->usage.utime.tv_usec / 1e6;
+    run->sys = job->usage.stime.tv_sec + job->usage.stime.tv_usec / 1e6;
+    run->maxrss = job->usage.maxrss;
+    run->status = exit_status(job);
+    run->outlier = false;
+
+    free_jobs();
+    return completed;
+}
+
+/* statistics */
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Linear interpolation between the closest ranks of sorted values.
+static double percentile(const double *sorted, size_t n, double p)
+{
+    if (n == 0)
+        return 0.0;
+
+    double rank = p * (n - 1);
+    size_t low = (size_t)rank;
+    if (low + 1 >= n)
+        return sorted[n - 1];
+    return sorted[low] + (rank - low) * (sorted[low + 1] - sorted[low]);
+}
+
+static void mark_outliers(BenchRun *runs, size_t n_runs)
+{
+    double *values = (double *)malloc(n_runs * sizeof(double));
+    if (values == NULL || n_runs < 3)
+    {
+        free(values);
+        return;
+    }
+
+    for (size_t i = 0; i < n_runs; i++)
+        values[i] = runs[i].wall;
+    qsort(values, n_runs, sizeof(double), compare_doubles);
+    double median = percentile(values, n_runs, 0.5);
+
+    for (size_t i = 0; i < n_runs; i++)
+        values[i] = fabs(runs[i].wall - median);
+    qsort(values, n_runs, sizeof(double), compare_doubles);
+    double mad = percentile(values, n_runs, 0.5); // median absolute deviation
+    free(values);
+
+    if (mad == 0.0)
+        return; // half the runs took exactly the median: nothing stands out from that
+
+    for (size_t i = 0; i < n_runs; i++)
+        runs[i].outlier = 0.6745 * fabs(runs[i].wall - median) / mad > OUTLIER_Z_SCORE;
+}
+
+static BenchStats compute_stats(const BenchRun *runs, size_t n_runs)
+{
+    BenchStats stats;
+    double *walls = (double *)malloc((n_runs > 0 ? n_runs : 1) * sizeof(double));
+    double sum = 0.0, user = 0.0, sys = 0.0;
+
+    memset(&stats, 0, sizeof(stats));
+    if (walls == NULL)
+        return stats;
+
+    for (size_t i = 0; i < n_runs; i++)
+    {
+        if (runs[i].outlier)
+            continue;
+        walls[stats.n++] = runs[i].wall;
+        sum += runs[i].wall;
+        user += runs[i].user;
+        sys += runs[i].sys;
+    }
+
+    if (stats.n > 0)
+    {
+        qsort(walls, stats.n, sizeof(double), compare_doubles);
+        stats.min = walls[0];
+        stats.max = walls[stats.n - 1];
+        stats.median = percentile(walls, stats.n, 0.5);
+        stats.p95 = percentile(walls, stats.n, 0.95);
+        stats.p99 = percentile(walls, stats.n, 0.99);
+        stats.mean = sum / stats.n;
+        stats.user_mean = user / stats.n;
+        stats.sys_mean = sys / stats.n;
+
+        double squares = 0.0;
+        for (size_t i = 0; i < stats.n; i++)
+            squares += (walls[i] - stats.mean) * (walls[i] - stats.mean);
+        stats.stddev = stats.n > 1 ? sqrt(squares / (stats.n - 1)) : 0.0;
+    }
+
+    free(walls);
+    return stats;
+}
+
+/* reports */
+
+static void print_stats(const char *line, const BenchStats *stats, size_t n_runs, size_t warmup, size_t failed,
+                        bool drop_outliers)
+{
+    printf("bench: %s\n", line);
+    printf("  %zu runs (+%zu warmup), %zu failed", n_runs, warmup, failed);
+    if (drop_outliers)
+        printf(", %zu outliers dropped", n_runs - stats->n);
+    printf("\n");
+    if (stats->n == 0)
+        return;
+
+    printf("  wall  min %.3f ms  median %.3f ms  mean %.3f ms \xc2\xb1 %.3f ms\n", stats->min * 1e3,
+           stats->median * 1e3, stats->mean * 1e3, stats->stddev * 1e3);
+    printf("        p95 %.3f ms  p99 %.3f ms  max %.3f ms\n", stats->p95 * 1e3, stats->p99 * 1e3, stats->max * 1e3);
+    printf("  cpu   user %.3f ms  sys %.3f ms (mean)\n", stats->user_mean * 1e3, stats->sys_mean * 1e3);
+}
+
+static FILE *open_export(const char *filepath)
+{
+    FILE *file = fopen(filepath, "w");
+    if (file == NULL)
+        printf("-shellman: bench: %s: %s\n", filepath, strerror(errno));
+    return file;
+}
+
+static void export_csv(const char *filepath, const BenchRun *runs, size_t n_runs)
+{
+    FILE *file = open_export(filepath);
+    if (file == NULL)
+        return;
+
+    fprintf(file, "run,wall_s,user_s,sys_s,maxrss_kib,status,outlier\n");
+    for (size_t i = 0; i < n_runs; i++)
+        fprintf(file, "%zu,%.9f,%.6f,%.6f,%ld,%d,%d\n", i + 1, runs[i].wall, runs[i].user, runs[i].sys,
+                runs[i].maxrss, runs[i].status, runs[i].outlier);
+    fclose(file);
+}
+
+static void write_json_string(FILE *file, const char *string)
+{
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void export_json(const char *filepath, const char *line, const BenchStats *stats, const BenchRun *runs,
+                        size_t n_runs, size_t warmup, size_t failed)
+{
+    FILE *file = open_export(filepath);
+    if (file == NULL)
+        return;
+
+    fprintf(file, "{\"command\": ");
+    write_json_string(file, line);
+    fprintf(file, ", \"runs\": %zu, \"warmup\": %zu, \"failed\": %zu, \"outliers\": %zu,\n", n_runs, warmup, failed,
+            n_runs - stats->n);
+    fprintf(file, " \"wall_s\": {\"min\": %.9f, \"median\": %.9f, \"mean\": %.9f, \"stddev\": %.9f, "
+                  "\"p95\": %.9f, \"p99\": %.9f, \"max\": %.9f},\n",
+            stats->min, stats->median, stats->mean, stats->stddev, stats->p95, stats->p99, stats->max);
+    fprintf(file, " \"user_s\": %.6f, \"sys_s\": %.6f,\n \"times_s\": [", stats->user_mean, stats->sys_mean);
+    for (size_t i = 0; i < n_runs; i++)
+        fprintf(file, "%s%.9f", i > 0 ? ", " : "", runs[i].wall);
+    fprintf(file, "],\n \"exit_codes\": [");
+    for (size_t i = 0; i < n_runs; i++)
+        fprintf(file, "%s%d", i > 0 ? ", " : "", runs[i].status);
+    fprintf(file, "]}\n");
+    fclose(file);
+}
+
+/* builtin command */
+
+void bench(Process *command)
+{
+    static const char usage[] = "bench -n 100 -w 3 -o -j out.json grep -c x big.txt | cat";
+    char **args = command->args + 1;
+    char *csv_filepath = NULL, *json_filepath = NULL;
+    long n_runs = BENCH_DEFAULT_RUNS, warmup = 0;
+    bool drop_outliers = false;
+    size_t i;
+
+    for (i = 0; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0' && args[i][2] == '\0'; i++)
+    {
+        if (args[i][1] == 'o')
+        {
+            drop_outliers = true;
+            continue;
+        }
+        if (args[i + 1] == NULL || strchr("nwcj", args[i][1]) == NULL)
+            break;
+
+        switch (args[i][1])
+        {
+        case 'n':
+            n_runs = atol(args[i + 1]);
+            break;
+        case 'w':
+            warmup = atol(args[i + 1]);
+            break;
+        case 'c':
+            csv_filepath = args[i + 1];
+            break;
+        case 'j':
+            json_filepath = args[i + 1];
+            break;
+        }
+        i++;
+    }
+
+    if (args[i] == NULL || n_runs <= 0 || warmup < 0)
+    {
+        printf("-shellman: bench example usage: `%s`\n", usage);
+        return;
+    }
+    if (command->job->background || shell->serving)
+    {
+        printf("-shellman: bench: runs in the foreground only, and not in daemon mode\n");
+        return;
+    }
+
+    // The pipeline to run is this very job without "bench" and its options.
+    size_t line_offset;
+    Job *template = copy_rest_of_line(command->job, i + 1, &line_offset);
+    if (template == NULL)
+    {
+        perror("-shellman: bench: new_job");
+        return;
+    }
+
+    BenchRun *runs = (BenchRun *)calloc(n_runs, sizeof(BenchRun));
+    size_t done = 0, failed = 0;
+    bool stopped = runs == NULL;
+
+    for (long w = 0; w < warmup && !stopped; w++)
+    {
+        BenchRun run;
+        stopped = !run_once(template, line_offset, &run);
+    }
+    for (; done < (size_t)n_runs && !stopped; done++)
+    {
+        if (!run_once(template, line_offset, &runs[done]))
+            break; // an interrupted run does not count
+        if (runs[done].status != 0)
+            failed++;
+    }
+
+    if (drop_outliers)
+        mark_outliers(runs, done);
+    BenchStats stats = compute_stats(runs, done);
+    const char *line = template->line + line_offset;
+
+    print_stats(line, &stats, done, warmup, failed, drop_outliers);
+    if (csv_filepath != NULL)
+        export_csv(csv_filepath, runs, done);
+    if (json_filepath != NULL)
+        export_json(json_filepath, line, &stats, runs, done, warmup, failed);
+
+    free(runs);
+    free_job(template);
+}
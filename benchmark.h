@@ -0,0 +1,64 @@
+#ifndef benchmark_h
+#define benchmark_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "process.h"
+
+#define BENCH_DEFAULT_RUNS 10
+#define OUTLIER_Z_SCORE 3.5 // modified z-score past which a run counts as an outlier
+
+/**
+ *
+ * `bench [-n N] [-w WARMUP] [-o] [-c FILE.csv] [-j FILE.json] CMD [ARG ...] [| CMD ...]`
+ *
+ * Runs the rest of the line, pipes and redirects included, WARMUP + N times in
+ * the foreground, each run a fresh copy of the parsed pipeline launched by
+ * run_job() and reaped by wait_fore_job(): the very path a typed line takes, so
+ * the numbers include spawning, process groups and the terminal hand-over.
+ *
+ * Wall time is the job's usage (CLOCK_MONOTONIC from the first spawn to the last
+ * exit), user and sys the rusage wait4() returned for its processes. The report
+ * has min, median, mean and standard deviation, p95, p99 and max of the wall time
+ * and the mean CPU times.
+ *
+ * -o drops outliers before the statistics: runs whose modified z-score
+ * 0.6745 * |x - median| / MAD exceeds OUTLIER_Z_SCORE (Iglewicz and Hoaglin),
+ * which a few slow runs cannot drag along the way they do a mean and stddev.
+ * -c writes one CSV row per run, -j the statistics and all wall times as JSON.
+ *
+ * A run killed by a signal (e.g. ^C) or stopped ends the benchmark early; runs
+ * that exit with a non-zero status are counted as failed but kept.
+ *
+**/
+typedef struct benchrun
+{
+    double wall; // seconds
+    double user;
+    double sys;
+    long maxrss; // KiB
+    int status;  // exit status, 128+N for signal N
+    bool outlier;
+} BenchRun;
+
+typedef struct benchstats
+{
+    size_t n; // runs the statistics are over
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double p95;
+    double p99;
+    double max;
+    double user_mean;
+    double sys_mean;
+} BenchStats;
+
+void bench(Process *command);
+
+#endif
@@ -0,0 +1,434 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "complete.h"
+#include "path.h"
+#include "util.h"
+
+// Layout of the records getdents64() fills the buffer with; glibc only exposes it since 2.30.
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static DirListing dir_cache[DIR_CACHE_SIZE];
+static uint64_t use_clock = 0;
+
+static TrieNode *nodes = NULL;
+static size_t n_nodes = 0;
+static size_t nodes_capacity = 0;
+
+static char *trie_path_env = NULL; // $PATH the trie was built from
+static DirListing *path_dirs = NULL;
+static size_t n_path_dirs = 0;
+
+/* directory listings */
+
+static void stat_mtime(const char *dir, struct timespec *mtime)
+{
+    struct stat st;
+    if (stat(dir, &st) == -1)
+    {
+        mtime->tv_sec = -1; // a missing directory that appears later counts as a change
+        mtime->tv_nsec = 0;
+        return;
+    }
+    *mtime = st.st_mtim;
+}
+
+static bool listing_changed(DirListing *listing)
+{
+    struct timespec mtime;
+    stat_mtime(listing->dir, &mtime);
+    return mtime.tv_sec != listing->mtime.tv_sec || mtime.tv_nsec != listing->mtime.tv_nsec;
+}
+
+static bool append_name(DirListing *listing, const char *name, unsigned char type, size_t *names_capacity,
+                        size_t *types_capacity)
+{
+    size_t size = strlen(name) + 1;
+
+    if (listing->names_size + size > *names_capacity)
+    {
+        size_t capacity = *names_capacity ? *names_capacity : 1024;
+        while (listing->names_size + size > capacity)
+            capacity *= 2;
+        char *names = (char *)realloc(listing->names, capacity);
+        if (names == NULL)
+            return false;
+        listing->names = names;
+        *names_capacity = capacity;
+    }
+    if (listing->n_entries == *types_capacity)
+    {
+        size_t capacity = *types_capacity ? *types_capacity * 2 : 64;
+        unsigned char *types = (unsigned char *)realloc(listing->types, capacity);
+        if (types == NULL)
+            return false;
+        listing->types = types;
+        *types_capacity = capacity;
+    }
+
+    memcpy(listing->names + listing->names_size, name, size);
+    listing->names_size += size;
+    listing->types[listing->n_entries++] = type;
+    return true;
+}
+
+// (Re)read the entries of listing->dir. A directory that cannot be opened is listed as empty.
+static void list_dir(DirListing *listing)
+{
+    static char buffer[GETDENTS_BUFFER_SIZE] __attribute__((aligned(8)));
+    size_t names_capacity = 0, types_capacity = 0;
+    struct stat st;
+    long n;
+
+    free(listing->names);
+    free(listing->types);
+    listing->names = NULL;
+    listing->types = NULL;
+    listing->names_size = 0;
+    listing->n_entries = 0;
+
+    int fd = open(listing->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        if (fd != -1)
+            close(fd);
+        listing->mtime.tv_sec = -1;
+        listing->mtime.tv_nsec = 0;
+        return;
+    }
+    listing->mtime = st.st_mtim; // taken before reading: a change made meanwhile is seen next time
+
+    while ((n = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (long pos = 0; pos < n;)
+        {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(buffer + pos);
+            pos += entry->d_reclen;
+
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+            if (!append_name(listing, entry->d_name, entry->d_type, &names_capacity, &types_capacity))
+                break;
+        }
+    }
+    close(fd);
+}
+
+static void free_listing(DirListing *listing)
+{
+    free(listing->dir);
+    free(listing->names);
+    free(listing->types);
+    memset(listing, 0, sizeof(DirListing));
+}
+
+// Listing of dir from the cache, read again if the directory changed since.
+static DirListing *cached_listing(const char *dir)
+{
+    DirListing *victim = NULL;
+
+    for (size_t i = 0; i < DIR_CACHE_SIZE; i++)
+    {
+        DirListing *listing = &dir_cache[i];
+        if (listing->dir != NULL && strcmp(listing->dir, dir) == 0)
+        {
+            if (listing_changed(listing))
+                list_dir(listing);
+            listing->last_used = ++use_clock;
+            return listing;
+        }
+        if (victim == NULL || (victim->dir != NULL && (listing->dir == NULL || listing->last_used < victim->last_used)))
+            victim = listing;
+    }
+
+    free_listing(victim);
+    victim->dir = strdup(dir);
+    list_dir(victim);
+    victim->last_used = ++use_clock;
+    return victim;
+}
+
+/* trie of command names */
+
+static uint32_t new_node(char c)
+{
+    if (n_nodes == nodes_capacity)
+    {
+        size_t capacity = nodes_capacity ? nodes_capacity * 2 : 4096;
+        TrieNode *grown = (TrieNode *)realloc(nodes, capacity * sizeof(TrieNode));
+        if (grown == NULL)
+            return 0;
+        nodes = grown;
+        nodes_capacity = capacity;
+    }
+    memset(&nodes[n_nodes], 0, sizeof(TrieNode));
+    nodes[n_nodes].c = c;
+    return n_nodes++;
+}
+
+// Child of node for c, created in byte order among its siblings if create is set. 0 if none.
+static uint32_t child_of(uint32_t node, char c, bool create)
+{
+    uint32_t prev = 0, child = nodes[node].child;
+
+    while (child != 0 && (unsigned char)nodes[child].c < (unsigned char)c)
+    {
+        prev = child;
+        child = nodes[child].sibling;
+    }
+    if (child != 0 && nodes[child].c == c)
+        return child;
+    if (!create)
+        return 0;
+
+    uint32_t created = new_node(c);
+    if (created == 0)
+        return 0;
+    nodes[created].sibling = child;
+    if (prev == 0)
+        nodes[node].child = created;
+    else
+        nodes[prev].sibling = created;
+    return created;
+}
+
+static void add_name(const char *name)
+{
+    uint32_t path[NAME_MAX + 1];
+    size_t depth = 0;
+    uint32_t node = 0;
+
+    for (const char *c = name; *c != '\0' && depth < NAME_MAX; c++)
+    {
+        if ((node = child_of(node, *c, true)) == 0)
+            return; // out of memory: leave the counts untouched
+        path[depth++] = node;
+    }
+
+    nodes[0].names++;
+    for (size_t i = 0; i < depth; i++)
+        nodes[path[i]].names++;
+    nodes[node].terminal++;
+}
+
+static void remove_name(const char *name)
+{
+    uint32_t path[NAME_MAX + 1];
+    size_t depth = 0;
+    uint32_t node = 0;
+
+    for (const char *c = name; *c != '\0' && depth < NAME_MAX; c++)
+    {
+        if ((node = child_of(node, *c, false)) == 0)
+            return;
+        path[depth++] = node;
+    }
+    if (nodes[node].terminal == 0)
+        return;
+
+    nodes[0].names--;
+    for (size_t i = 0; i < depth; i++)
+        nodes[path[i]].names--;
+    nodes[node].terminal--;
+}
+
+static bool is_command_entry(const char *name, unsigned char type)
+{
+    return name[0] != '.' && type != DT_DIR;
+}
+
+static void update_path_names(DirListing *listing, void (*update)(const char *name))
+{
+    const char *name = listing->names;
+    for (size_t i = 0; i < listing->n_entries; i++, name += strlen(name) + 1)
+    {
+        if (is_command_entry(name, listing->types[i]))
+            update(name);
+    }
+}
+
+static void reset_trie(const char *path_env)
+{
+    for (size_t i = 0; i < n_path_dirs; i++)
+        free_listing(&path_dirs[i]);
+    free(path_dirs);
+    free(trie_path_env);
+
+    n_nodes = 0;
+    new_node('\0'); // the root
+    for (size_t i = 0; i < n_builtins; i++)
+        add_name(builtins[i]);
+    for (size_t i = 0; i < n_stage_builtins; i++)
+        add_name(stage_builtins[i]);
+
+    trie_path_env = strdup(path_env);
+    n_path_dirs = 1;
+    for (const char *c = path_env; *c != '\0'; c++)
+        n_path_dirs += (*c == ':');
+    path_dirs = (DirListing *)calloc(n_path_dirs, sizeof(DirListing));
+
+    const char *start = path_env;
+    for (size_t i = 0; i < n_path_dirs; i++)
+    {
+        const char *end = strchr(start, ':');
+        size_t len = end != NULL ? (size_t)(end - start) : strlen(start);
+
+        path_dirs[i].dir = len > 0 ? strndup(start, len) : strdup(".");
+        path_dirs[i].mtime.tv_nsec = -1; // never listed
+        start += len + 1;
+    }
+}
+
+// Bring the trie up to date with $PATH, listing again only the directories that changed.
+static void sync_trie()
+{
+    const char *path_env = getenv("PATH");
+    if (path_env == NULL)
+        path_env = DEFAULT_PATH;
+
+    if (trie_path_env == NULL || strcmp(trie_path_env, path_env) != 0)
+        reset_trie(path_env);
+
+    for (size_t i = 0; i < n_path_dirs; i++)
+    {
+        if (!listing_changed(&path_dirs[i]))
+            continue;
+        update_path_names(&path_dirs[i], remove_name);
+        list_dir(&path_dirs[i]);
+        update_path_names(&path_dirs[i], add_name);
+    }
+}
+
+/* completions */
+
+static void add_completion(Completions *completions, const char *word, size_t len, bool is_dir)
+{
+    if (completions->count == completions->capacity)
+    {
+        size_t capacity = completions->capacity ? completions->capacity * 2 : 64;
+        char **items = (char **)realloc(completions->items, capacity * sizeof(char *));
+        if (items == NULL)
+            return;
+        completions->items = items;
+        completions->capacity = capacity;
+    }
+
+    char *item = (char *)malloc(len + 2);
+    if (item == NULL)
+        return;
+    memcpy(item, word, len);
+    if (is_dir)
+        item[len++] = '/';
+    item[len] = '\0';
+    completions->items[completions->count++] = item;
+}
+
+static void collect_names(Completions *completions, uint32_t node, char *word, size_t len)
+{
+    if (nodes[node].terminal > 0)
+        add_completion(completions, word, len, false);
+
+    for (uint32_t child = nodes[node].child; child != 0; child = nodes[child].sibling)
+    {
+        if (nodes[child].names == 0 || len + 1 >= PATH_MAX)
+            continue;
+        word[len] = nodes[child].c;
+        collect_names(completions, child, word, len + 1);
+    }
+}
+
+void complete_command(Completions *completions, const char *prefix, size_t len)
+{
+    char word[PATH_MAX];
+    uint32_t node = 0;
+
+    if (len >= PATH_MAX)
+        return;
+
+    sync_trie();
+    for (size_t i = 0; i < len; i++)
+    {
+        if ((node = child_of(node, prefix[i], false)) == 0 || nodes[node].names == 0)
+            return;
+    }
+
+    memcpy(word, prefix, len);
+    collect_names(completions, node, word, len);
+}
+
+void complete_path(Completions *completions, const char *prefix, size_t len)
+{
+    char dir[PATH_MAX], word[PATH_MAX], path[PATH_MAX + NAME_MAX + 2];
+    size_t dir_len = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (prefix[i] == '/')
+            dir_len = i + 1;
+    }
+    if (len >= PATH_MAX)
+        return;
+
+    memcpy(dir, prefix, dir_len);
+    strcpy(dir + dir_len, dir_len > 0 ? "" : ".");
+    const char *base = prefix + dir_len;
+    size_t base_len = len - dir_len;
+
+    DirListing *listing = cached_listing(dir);
+    const char *name = listing->names;
+    for (size_t i = 0; i < listing->n_entries; i++, name += strlen(name) + 1)
+    {
+        size_t name_len = strlen(name);
+        if (name_len < base_len || memcmp(name, base, base_len) != 0)
+            continue;
+        if (name[0] == '.' && base_len == 0)
+            continue; // hidden unless asked for
+        if (dir_len + name_len >= PATH_MAX)
+            continue;
+
+        bool is_dir = listing->types[i] == DT_DIR;
+        if (listing->types[i] == DT_LNK || listing->types[i] == DT_UNKNOWN)
+        {
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%s", dir, name);
+            is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        memcpy(word, prefix, dir_len);
+        memcpy(word + dir_len, name, name_len);
+        add_completion(completions, word, dir_len + name_len, is_dir);
+    }
+}
+
+size_t common_prefix(const Completions *completions)
+{
+    if (completions->count == 0)
+        return 0;
+
+    size_t len = strlen(completions->items[0]);
+    for (size_t i = 1; i < completions->count; i++)
+    {
+        size_t j = 0;
+        while (j < len && completions->items[i][j] == completions->items[0][j])
+            j++;
+        len = j;
+    }
+    return len;
+}
+
+void clear_completions(Completions *completions)
+{
+    for (size_t i = 0; i < completions->count; i++)
+        free(completions->items[i]);
+    completions->count = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef complete_h
+#define complete_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DIR_CACHE_SIZE 64 // directory listings kept for path completion
+#define GETDENTS_BUFFER_SIZE 32768
+
+/**
+ *
+ * Tab completion of command names and paths.
+ *
+ * A directory is listed with raw getdents64() calls into a DirListing (the names
+ * back to back, NUL-separated, with the d_type of each) and the listing is kept
+ * along with the directory's mtime: it is reused until the mtime changes.
+ *
+ * Command names live in a trie over all the PATH directories and the builtins.
+ * A node counts how many directories hold the name ending there (terminal) and
+ * how many names pass through it (names), so a directory that changed is merged
+ * in place: the names of its old listing are taken out, the new ones put in, and
+ * the other directories are not read again. Nodes whose names all went away stay
+ * in the pool and are skipped.
+ *
+ * Entries that are not directories are taken as executables without stat()ing
+ * each of them, which would cost one syscall per name on every change of /usr/bin.
+ *
+**/
+typedef struct dirlisting
+{
+    char *dir; // NULL if the slot is free
+    struct timespec mtime;
+    char *names;           // n_entries NUL-terminated names, back to back
+    size_t names_size;
+    unsigned char *types; // d_type of each name
+    size_t n_entries;
+    uint64_t last_used;
+} DirListing;
+
+typedef struct trienode
+{
+    uint32_t child;   // first child, or 0 (node 0 is the root, never anyone's child)
+    uint32_t sibling; // next child of the same parent, or 0
+    uint32_t terminal; // directories (and builtins) holding the name that ends here
+    uint32_t names;    // names ending here or below, with multiplicity
+    char c;
+} TrieNode;
+
+typedef struct completions
+{
+    char **items; // each one replaces the whole word; directories end with '/'
+    size_t count;
+    size_t capacity;
+} Completions;
+
+// Commands (from $PATH and the builtins) starting with prefix.
+void complete_command(Completions *completions, const char *prefix, size_t len);
+// Paths starting with prefix, relative to the current directory unless absolute.
+void complete_path(Completions *completions, const char *prefix, size_t len);
+// Length of the longest prefix shared by every item.
+size_t common_prefix(const Completions *completions);
+void clear_completions(Completions *completions);
+
+#endif
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE // splice()
+
+#include <sys/sendfile.h>
+
+#include "copy.h"
+
+static int copy_read_write(int in_fd, int out_fd)
+{
+    char *buffer = (char *)malloc(COPY_CHUNK_SIZE);
+    if (buffer == NULL)
+        return -1;
+
+    while (1)
+    {
+        ssize_t n = read(in_fd, buffer, COPY_CHUNK_SIZE);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            free(buffer);
+            return n;
+        }
+
+        for (ssize_t written = 0; written < n;)
+        {
+            ssize_t m = write(out_fd, buffer + written, n - written);
+            if (m == -1 && errno == EINTR)
+                continue;
+            if (m == -1)
+            {
+                free(buffer);
+                return -1;
+            }
+            written += m;
+        }
+    }
+}
+
+// Return 0 when done, -1 on error, or 1 if the kernel refused before anything was moved.
+static int copy_zero(int in_fd, int out_fd, bool use_splice)
+{
+    bool moved = false;
+
+    while (1)
+    {
+        ssize_t n;
+        if (use_splice)
+            n = splice(in_fd, NULL, out_fd, NULL, COPY_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+        else
+            n = sendfile(out_fd, in_fd, NULL, COPY_CHUNK_SIZE);
+
+        if (n == 0)
+            return 0;
+        if (n > 0)
+        {
+            moved = true;
+            continue;
+        }
+
+        if (errno == EINTR)
+            continue;
+        if (!moved && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+            return 1;
+        return -1;
+    }
+}
+
+int copy_fd(int in_fd, int out_fd)
+{
+    struct stat in_st, out_st;
+    int ret = 1;
+
+    if (fstat(in_fd, &in_st) == -1 || fstat(out_fd, &out_st) == -1)
+        return -1;
+
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode))
+        ret = copy_zero(in_fd, out_fd, true); // splice() needs a pipe on one side
+    else if (S_ISREG(in_st.st_mode))
+        ret = copy_zero(in_fd, out_fd, false);
+
+    if (ret == 1)
+        ret = copy_read_write(in_fd, out_fd);
+
+    return ret;
+}
+
+/* builtin command */
+
+int copy(char **args)
+{
+    int status = 0;
+
+    if (args[0] == NULL)
+    {
+        if (copy_fd(STDIN_FILENO, STDOUT_FILENO) == -1)
+        {
+            fprintf(stderr, "-shellman: copy: %s\n", strerror(errno));
+            status = 1;
+        }
+        return status;
+    }
+
+    for (size_t i = 0; args[i] != NULL; i++)
+    {
+        int fd = open(args[i], O_RDONLY);
+        if (fd == -1 || copy_fd(fd, STDOUT_FILENO) == -1)
+        {
+            fprintf(stderr, "-shellman: copy: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+        }
+        if (fd != -1)
+            close(fd);
+    }
+    return status;
+}
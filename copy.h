@@ -0,0 +1,23 @@
+#ifndef copy_h
+#define copy_h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define COPY_CHUNK_SIZE (1 << 20)
+
+// Move everything from in_fd to out_fd with splice(2) or sendfile(2) when the kernel
+// allows it, falling back to a read/write loop. Return 0, or -1 on error.
+int copy_fd(int in_fd, int out_fd);
+
+// `copy [FILE ...]`: a pipeline stage that writes FILEs (or stdin) to stdout.
+// It runs in a forked child of the shell, without exec.
+int copy(char **args);
+
+#endif
@@ -0,0 +1,206 @@
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+
+#include "event.h"
+#include "admit.h"
+#include "job.h"
+#include "lineedit.h"
+#include "parser.h"
+
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static bool stdin_always_ready = false; // a regular file, which epoll refuses: read without waiting
+
+// epoll_event.data.ptr is either one of these markers or the watched Process.
+static char stdin_marker, signal_marker, extra_marker;
+static void (*extra_ready)() = NULL;
+
+static int add_fd(int fd, void *ptr)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = ptr;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Undo a partial init_events(): no event loop, and SIGCHLD delivered as before.
+static int fail_events(const char *what)
+{
+    sigset_t mask;
+
+    perror(what);
+    if (epoll_fd != -1)
+        close(epoll_fd);
+    if (signal_fd != -1)
+        close(signal_fd);
+    epoll_fd = signal_fd = -1;
+    stdin_always_ready = false;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    return -1;
+}
+
+int init_events(bool watch_stdin)
+{
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
+        return fail_events("-shellman: sigprocmask");
+
+    if ((signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+        return fail_events("-shellman: signalfd");
+
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        return fail_events("-shellman: epoll_create1");
+
+    if (watch_stdin && add_fd(STDIN_FILENO, &stdin_marker) == -1)
+    {
+        if (errno != EPERM)
+            return fail_events("-shellman: epoll_ctl");
+        stdin_always_ready = true; // e.g. `shellman < commands.txt`
+    }
+    if (add_fd(signal_fd, &signal_marker) == -1)
+        return fail_events("-shellman: epoll_ctl");
+    return 0;
+}
+
+void watch_process(Process *process)
+{
+    if (epoll_fd == -1)
+        return;
+
+    int pidfd = syscall(SYS_pidfd_open, process->pid, 0);
+    if (pidfd == -1)
+        return; // e.g. ENOSYS on old kernels: the SIGCHLD signalfd still reaps it
+
+    fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+    if (add_fd(pidfd, process) == -1)
+    {
+        close(pidfd);
+        return;
+    }
+    process->pidfd = pidfd;
+}
+
+void unwatch_process(Process *process)
+{
+    if (process->pidfd)
+    {
+        close(process->pidfd); // closing the last reference also removes it from the epoll set
+        process->pidfd = 0;
+    }
+}
+
+int watch_events(int fd, void (*ready)())
+{
+    extra_ready = ready;
+    return add_fd(fd, &extra_marker);
+}
+
+static int drain_signals()
+{
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+        ;
+
+    return wait_back_job();
+}
+
+void wait_for_input(const char *prompt)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    if (epoll_fd == -1)
+    {
+        while (line_editor_enabled() && !input_ready())
+            edit_input(); // no event loop: block on the keys
+        return;
+    }
+
+    while (!input_ready())
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, stdin_always_ready ? 0 : admission_timeout());
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("-shellman: epoll_wait");
+            return; // fall back to a blocking read
+        }
+
+        int n_notices = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == &stdin_marker)
+            {
+                if ((line_editor_enabled() ? edit_input() : read_input()) <= 0)
+                    return; // EOF or error: let read_command_line() report it
+                continue;
+            }
+
+            hide_line(); // notices go where the line being edited was
+            if (events[i].data.ptr == &signal_marker)
+                n_notices += drain_signals();
+            else if (events[i].data.ptr == &extra_marker)
+                extra_ready();
+            else
+                n_notices += reap_process((Process *)events[i].data.ptr);
+        }
+
+        if (can_admit()) // room was made, or the load went down
+        {
+            hide_line();
+            n_notices += admit_jobs();
+        }
+
+        free_jobs(); // e.g. tasks of a background parallel pool
+
+        if (line_editor_enabled())
+        {
+            show_line();
+        }
+        else if (n_notices > 0)
+        {
+            printf("%s", prompt);
+            fflush(stdout);
+        }
+
+        if (stdin_always_ready && read_input() <= 0)
+            return; // EOF or error: let read_command_line() report it
+    }
+}
+
+void run_event_loop()
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1)
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, admission_timeout());
+        if (n == -1 && errno != EINTR)
+        {
+            perror("-shellman: epoll_wait");
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == &signal_marker)
+                drain_signals();
+            else if (events[i].data.ptr == &extra_marker)
+                extra_ready();
+            else
+                reap_process((Process *)events[i].data.ptr);
+        }
+
+        admit_jobs();
+        free_jobs();
+        fflush(stdout); // notices, to wherever the log goes
+    }
+}
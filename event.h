@@ -0,0 +1,44 @@
+#ifndef event_h
+#define event_h
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "process.h"
+
+#define MAX_EVENTS 64
+
+/**
+ *
+ * Event loop of the interactive shell.
+ *
+ * One epoll instance watches stdin, a signalfd for SIGCHLD (SIGCHLD is blocked and
+ * only delivered through it) and a pidfd per launched process. A readable pidfd is
+ * routed straight to its Process; the signalfd catches every other status change
+ * (stops, and processes whose pidfd could not be opened) through wait_back_job().
+ * Background jobs are thus reaped, and their notices printed, while the shell
+ * sits at the prompt.
+ *
+ * The daemon (server.h) runs the same loop without stdin: its own epoll
+ * instance, which watches its socket and clients, is nested into this one.
+ *
+**/
+
+// Set up epoll and the SIGCHLD signalfd, and watch stdin if asked (a regular file is read without waiting).
+// Return -1 on error, with everything undone.
+int init_events(bool watch_stdin);
+// Also wait on fd (e.g. another epoll instance) and call ready() whenever it is readable.
+int watch_events(int fd, void (*ready)());
+// Watch a launched process with a pidfd. No-op if init_events() has not been called.
+void watch_process(Process *process);
+void unwatch_process(Process *process);
+// Block until a complete line is buffered on stdin (or stdin hit EOF), reaping children meanwhile.
+void wait_for_input(const char *prompt);
+// Reap, admit and call the ready() of watch_events() forever: the loop of the daemon.
+void run_event_loop();
+
+#endif
@@ -0,0 +1,265 @@
+#define _GNU_SOURCE // clone flags
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "forkserver.h"
+#include "util.h"
+
+typedef struct launch_request
+{
+    pid_t pgid;
+    bool has_stdin;  // the first SCM_RIGHTS fd is the new stdin
+    bool has_stdout; // the next one is the new stdout
+    int argc;        // path, then argc NUL-terminated arguments follow the header
+} LaunchRequest;
+
+static int server_fd = -1; // the shell's end of the socketpair
+
+/* fork server side */
+
+// Runs in the clone of the fork server; never returns.
+static void exec_request(LaunchRequest *request, char *path, char **argv, int *fds)
+{
+    int n_fds = 0;
+
+    set_default();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+
+    setpgid(0, request->pgid);
+
+    if (request->has_stdin && dup2(fds[n_fds++], STDIN_FILENO) == -1)
+        _exit(127);
+    if (request->has_stdout && dup2(fds[n_fds++], STDOUT_FILENO) == -1)
+        _exit(127);
+    for (int i = 0; i < n_fds; i++)
+        close(fds[i]);
+
+    execv(path, argv);
+    perror("-shellman: exec");
+    _exit(127);
+}
+
+static pid_t serve_request(char *data, size_t size, int *fds, int n_fds)
+{
+    static char *argv[FORK_SERVER_MAX_REQUEST / 2 + 1]; // every argument takes at least its NUL
+    LaunchRequest *request = (LaunchRequest *)data;
+
+    if (size < sizeof(LaunchRequest) || request->argc < 0 || request->argc > FORK_SERVER_MAX_REQUEST / 2 ||
+        n_fds != request->has_stdin + request->has_stdout || data[size - 1] != '\0')
+        return -EINVAL;
+
+    char *path = data + sizeof(LaunchRequest);
+    char *cur = path + strlen(path) + 1;
+    for (int i = 0; i < request->argc; i++)
+    {
+        if (cur >= data + size)
+            return -EINVAL;
+        argv[i] = cur;
+        cur += strlen(cur) + 1;
+    }
+    argv[request->argc] = NULL;
+
+    // CLONE_PARENT: the new process is the shell's child, and the shell gets its SIGCHLD.
+    pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+    if (pid == 0)
+        exec_request(request, path, argv, fds);
+
+    return pid == -1 ? -errno : pid;
+}
+
+static void run_fork_server(int fd)
+{
+    static char data[FORK_SERVER_MAX_REQUEST];
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    sigset_t mask;
+
+    // Ctrl+C and Ctrl+\ are for the foreground job, not for a helper in the shell's process group.
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    fcntl(fd, F_SETFD, FD_CLOEXEC); // not for the launched processes
+
+    while (1)
+    {
+        struct iovec iov = {data, sizeof(data)};
+        struct msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t size = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (size == -1 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            _exit(0); // the shell is gone
+
+        int fds[2], n_fds = 0;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                if (n_fds > 2)
+                    n_fds = 2;
+                memcpy(fds, CMSG_DATA(cmsg), n_fds * sizeof(int));
+            }
+        }
+
+        pid_t pid = serve_request(data, size, fds, n_fds);
+        for (int i = 0; i < n_fds; i++)
+            close(fds[i]);
+
+        while (send(fd, &pid, sizeof(pid), 0) == -1 && errno == EINTR)
+            ;
+    }
+}
+
+void fork_server_main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], FORK_SERVER_ARG) == 0)
+        run_fork_server(atoi(argv[2]));
+}
+
+/* shell side */
+
+bool fork_server_accepts(Process *process, const char *path)
+{
+    size_t size = sizeof(LaunchRequest) + strlen(path) + 1;
+
+    for (size_t i = 0; i < process->n_args && size <= FORK_SERVER_MAX_REQUEST; i++)
+        size += strlen(process->args[i]) + 1;
+    return size <= FORK_SERVER_MAX_REQUEST;
+}
+
+bool start_fork_server()
+{
+    int fds[2];
+    char fd_arg[16];
+
+    if (server_fd != -1)
+        return true;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        perror("-shellman: fork server: socketpair");
+        return false;
+    }
+
+    pid_t pid = fork(); // once: the helper replaces this copy of the shell with a fresh image right away
+    if (pid == -1)
+    {
+        perror("-shellman: fork server: fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    else if (pid == 0)
+    {
+        close(fds[0]);
+        fcntl(fds[1], F_SETFD, 0); // keep the server end across exec
+        snprintf(fd_arg, sizeof(fd_arg), "%d", fds[1]);
+        execl("/proc/self/exe", "shellman", FORK_SERVER_ARG, fd_arg, (char *)NULL);
+        perror("-shellman: fork server: exec");
+        _exit(1);
+    }
+
+    close(fds[1]);
+    server_fd = fds[0];
+    return true;
+}
+
+// The helper is reaped by wait_back_job() like any unknown child.
+static void stop_fork_server()
+{
+    close(server_fd);
+    server_fd = -1;
+}
+
+pid_t fork_server_spawn(Process *process, const char *path, pid_t pgid)
+{
+    static char data[FORK_SERVER_MAX_REQUEST];
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    LaunchRequest *request = (LaunchRequest *)data;
+    int fds[2], n_fds = 0;
+
+    if (!start_fork_server())
+        return -1;
+
+    memset(request, 0, sizeof(LaunchRequest));
+    request->pgid = pgid;
+    if (process->read_fd)
+    {
+        request->has_stdin = true;
+        fds[n_fds++] = process->read_fd;
+    }
+    if (process->write_fd)
+    {
+        request->has_stdout = true;
+        fds[n_fds++] = process->write_fd;
+    }
+
+    size_t size = sizeof(LaunchRequest);
+    request->argc = process->n_args;
+    for (int i = -1; i < request->argc; i++)
+    {
+        const char *string = i == -1 ? path : process->args[i];
+        size_t len = strlen(string) + 1;
+        if (size + len > sizeof(data))
+        {
+            printf("-shellman: fork server: arguments too long\n");
+            return -1;
+        }
+        memcpy(data + size, string, len);
+        size += len;
+    }
+
+    struct iovec iov = {data, size};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (n_fds > 0)
+    {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(n_fds * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(n_fds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, n_fds * sizeof(int));
+    }
+
+    pid_t pid;
+    ssize_t n;
+    while ((n = sendmsg(server_fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+        ;
+    if (n != -1)
+    {
+        while ((n = recv(server_fd, &pid, sizeof(pid), 0)) == -1 && errno == EINTR)
+            ;
+    }
+
+    if (n <= 0)
+    {
+        if (n == -1)
+            perror("-shellman: fork server");
+        else
+            printf("-shellman: fork server exited\n");
+        stop_fork_server(); // started again on the next launch
+        return -1;
+    }
+    if (pid < 0)
+    {
+        printf("-shellman: fork server: %s\n", strerror(-pid));
+        return -1;
+    }
+    return pid;
+}
@@ -0,0 +1,42 @@
+#ifndef forkserver_h
+#define forkserver_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "process.h"
+
+#define FORK_SERVER_ARG "--fork-server"
+#define FORK_SERVER_MAX_REQUEST (64 * 1024)
+
+/**
+ *
+ * Fork server ("zygote") for the `forkserver` spawn backend.
+ *
+ * fork() from the shell copies the page tables of everything the shell holds, so
+ * its cost grows with the shell's RSS. The fork server is a helper started once
+ * by re-executing /proc/self/exe, so it holds only a fresh image of a few hundred
+ * KiB. The shell sends it one request per process over a SOCK_SEQPACKET socketpair:
+ * the path, the argv and the pgid in the payload, stdin/stdout as SCM_RIGHTS.
+ *
+ * The helper creates the process with clone(CLONE_PARENT), so the process is a
+ * child of the shell, not of the helper: wait4(), pidfds, setpgid() and terminal
+ * control work exactly as for the other backends. The helper replies with the pid
+ * (or -errno) once the process exists.
+ *
+**/
+
+// Run the fork server and exit if argv is FORK_SERVER_ARG <fd>; otherwise return.
+// Every main() that may use the `forkserver` backend calls this first.
+void fork_server_main(int argc, char **argv);
+// Start the fork server if it is not running yet. Return false if it could not be started.
+bool start_fork_server();
+// false if the argv of process is too long for one request.
+bool fork_server_accepts(Process *process, const char *path);
+// Launch process through the fork server. Return the pid, or -1 if nothing was launched.
+pid_t fork_server_spawn(Process *process, const char *path, pid_t pgid);
+
+#endif
@@ -0,0 +1,93 @@
+#define _GNU_SOURCE // memfd_create()
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "heredoc.h"
+#include "parser.h"
+
+static bool read_here_document(Job *job, Process *process, LineReader next_line)
+{
+    size_t delimiter_len = strlen(process->here_delimiter);
+    char *body = NULL;
+    size_t size = 0, capacity = 0;
+    const char *line;
+    ssize_t line_len;
+
+    while (1)
+    {
+        if ((line_len = next_line(&line)) == -1)
+        {
+            printf("-shellman: here-document delimited by end-of-file (wanted `%s')\n", process->here_delimiter);
+            break;
+        }
+        if ((size_t)line_len == delimiter_len && memcmp(line, process->here_delimiter, delimiter_len) == 0)
+            break;
+
+        if (size + line_len + 1 > capacity)
+        {
+            size_t grown_capacity = capacity ? capacity * 2 : MAX_BUFFER_SIZE;
+            while (size + line_len + 1 > grown_capacity)
+                grown_capacity *= 2;
+            char *grown = (char *)realloc(body, grown_capacity);
+            if (grown == NULL)
+            {
+                free(body);
+                return false;
+            }
+            body = grown;
+            capacity = grown_capacity;
+        }
+        memcpy(body + size, line, line_len);
+        body[size + line_len] = '\n';
+        size += line_len + 1;
+    }
+
+    // the job owns the body from here on
+    process->here_body = (char *)arena_alloc(job->arena, size + 1);
+    if (process->here_body != NULL && size > 0)
+        memcpy(process->here_body, body, size);
+    process->here_size = size;
+    free(body);
+    return process->here_body != NULL;
+}
+
+bool read_here_documents(Job *job, LineReader next_line)
+{
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+    {
+        if (cur_proc->here_delimiter != NULL && !read_here_document(job, cur_proc, next_line))
+            return false;
+    }
+    return true;
+}
+
+int here_document_fd(const char *body, size_t size)
+{
+    int fd = memfd_create("here-document", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1)
+    {
+        perror("-shellman: memfd_create");
+        return -1;
+    }
+
+    for (size_t done = 0; done < size;)
+    {
+        ssize_t n = write(fd, body + done, size - done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            perror("-shellman: here-document: write");
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+
+    // the stage sees exactly this body, whatever it or anyone else holding the fd tries
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+        perror("-shellman: here-document: F_ADD_SEALS");
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
@@ -0,0 +1,35 @@
+#ifndef heredoc_h
+#define heredoc_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+
+/**
+ *
+ * Here-documents (`CMD <<WORD`, then the lines up to one that is exactly WORD)
+ * and here-strings (`CMD <<< WORD`, i.e. WORD and a newline) as the stdin of a
+ * stage.
+ *
+ * parse() keeps the text of a here-string, and the delimiter of a here-document
+ * whose lines read_here_documents() collects from the script or the terminal
+ * once the line is parsed, as the here_body of the process. When the stage is
+ * launched, run_job() writes the body into an anonymous memfd_create() file,
+ * seals it against any change and rewinds it, and the file becomes the stage's
+ * read_fd: nothing touches the filesystem, and there is no file to unlink.
+ *
+**/
+
+// Source of the lines of a here-document: set *line and return its length (without '\n'), or -1 at EOF.
+typedef ssize_t (*LineReader)(const char **line);
+
+// Read the body of every here-document of the job. Return false if out of memory.
+bool read_here_documents(Job *job, LineReader next_line);
+// Sealed memfd holding size bytes of body, at offset 0. Return -1 on error.
+int here_document_fd(const char *body, size_t size);
+
+#endif
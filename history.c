@@ -0,0 +1,676 @@
+#define _GNU_SOURCE // memmem()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "history.h"
+#include "job.h"
+
+#define ALIGN8(size) (((size) + 7) & ~(size_t)7)
+#define INDEX_INITIAL_CAPACITY 4096
+#define COMMON_MIN_COUNT 4096 // a trigram of a small history is never common: its postings are few anyway
+
+static int history_fd = -1;
+static char index_path[PATH_MAX + sizeof(HISTORY_INDEX_SUFFIX)];
+static const char *mapping = NULL;
+static size_t mapped_size = 0;
+
+// the index file (history.h), mapped read-only: records [0, file_records)
+static const char *index_file = NULL;
+static size_t index_file_size = 0;
+static ino_t index_file_ino = 0;
+static struct timespec index_file_mtime;
+static const uint64_t *file_offsets = NULL;
+static const IndexedTrigram *file_trigrams = NULL;
+static const uint32_t *file_postings = NULL;
+static size_t file_trigram_count = 0;
+static size_t file_records = 0;
+
+static uint64_t *offsets = NULL; // of every valid record past the index file, by id - file_records
+static size_t n_records = 0;     // in all
+static size_t offsets_capacity = 0;
+static size_t scanned_size = 0; // the file has been split into records up to here
+
+// in-memory index of records [file_records, indexed_records)
+static TrigramPostings *index_table = NULL;
+static size_t index_capacity = 0; // always a power of 2
+static size_t index_count = 0;
+static size_t indexed_records = 0;
+static size_t index_bytes = 0; // of the table and its postings
+static size_t index_max_bytes = HISTORY_TAIL_MAX_BYTES;
+static bool indexer_started = false; // since the index file was last adopted
+
+static void start_indexer();
+static bool load_index_file();
+
+void init_history()
+{
+    char path[PATH_MAX];
+    char *histfile = getenv("SHELLMAN_HISTFILE");
+    char *home = getenv("HOME");
+    struct stat st;
+
+    if (histfile != NULL && histfile[0] != '\0')
+        snprintf(path, sizeof(path), "%s", histfile);
+    else if (home != NULL)
+        snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE_NAME);
+    else
+        return;
+
+    if ((history_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600)) == -1)
+    {
+        printf("-shellman: history: %s: %s\n", path, strerror(errno));
+        return;
+    }
+    snprintf(index_path, sizeof(index_path), "%s%s", path, HISTORY_INDEX_SUFFIX);
+
+    load_index_file();
+    if (fstat(history_fd, &st) == 0 && (size_t)st.st_size >= scanned_size + HISTORY_INDEX_LAG_BYTES)
+        start_indexer();
+}
+
+// Map the whole file again if another shell (or this one) appended to it.
+static bool refresh_mapping()
+{
+    struct stat st;
+
+    if (history_fd == -1 || fstat(history_fd, &st) == -1)
+        return false;
+    if ((size_t)st.st_size == mapped_size)
+        return true;
+
+    if (mapping != NULL)
+        munmap((void *)mapping, mapped_size);
+    mapping = NULL;
+    mapped_size = 0;
+
+    if (st.st_size == 0)
+        return true;
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, history_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        perror("-shellman: history: mmap");
+        return false;
+    }
+    mapping = map;
+    mapped_size = st.st_size;
+    return true;
+}
+
+static bool push_offset(uint64_t offset)
+{
+    size_t n = n_records - file_records;
+
+    if (n == offsets_capacity)
+    {
+        size_t capacity = offsets_capacity ? offsets_capacity * 2 : INDEX_INITIAL_CAPACITY;
+        uint64_t *grown = (uint64_t *)realloc(offsets, capacity * sizeof(uint64_t));
+        if (grown == NULL)
+            return false;
+        offsets = grown;
+        offsets_capacity = capacity;
+    }
+    offsets[n] = offset;
+    n_records++;
+    return true;
+}
+
+// Split the part of the file not seen yet into records.
+static void scan_records()
+{
+    if (!refresh_mapping())
+        return;
+
+    while (scanned_size + sizeof(HistoryRecord) <= mapped_size)
+    {
+        const HistoryRecord *record = (const HistoryRecord *)(mapping + scanned_size);
+
+        if (record->magic != HISTORY_MAGIC || record->size % 8 != 0 ||
+            record->size < sizeof(HistoryRecord) + record->line_len + 1 || record->size > mapped_size - scanned_size)
+        {
+            if (record->magic == HISTORY_MAGIC && record->size % 8 == 0 && record->size > mapped_size - scanned_size &&
+                record->size >= sizeof(HistoryRecord) + record->line_len + 1)
+                break; // still being written by another shell, or cut short: look again next time
+            scanned_size += 8; // garbage: resynchronize on the next aligned magic number
+            continue;
+        }
+
+        if (!push_offset(scanned_size))
+            break;
+        scanned_size += record->size;
+    }
+}
+
+size_t history_size()
+{
+    scan_records();
+    return n_records;
+}
+
+const HistoryRecord *history_record(size_t id)
+{
+    if (id >= n_records)
+        return NULL;
+    if (id < file_records)
+        return (const HistoryRecord *)(mapping + file_offsets[id]);
+    return (const HistoryRecord *)(mapping + offsets[id - file_records]);
+}
+
+void record_history(Job *job)
+{
+    struct timespec now;
+    int status = 127;
+
+    if (history_fd == -1 || job->line == NULL || job->line[0] == '\0')
+        return;
+
+    // the exit status of a pipeline is that of its last process
+    Process *last = job->process_queue;
+    while (last->next != NULL)
+        last = last->next;
+    if (job->job_mode == BUILTIN_MODE)
+        status = 0;
+    else if (last->pid != 0 && WIFEXITED(last->status))
+        status = WEXITSTATUS(last->status);
+    else if (last->pid != 0 && WIFSIGNALED(last->status))
+        status = 128 + WTERMSIG(last->status);
+
+    size_t line_len = strlen(job->line);
+    size_t size = ALIGN8(sizeof(HistoryRecord) + line_len + 1);
+    HistoryRecord *record = (HistoryRecord *)calloc(1, size);
+    if (record == NULL)
+        return;
+
+    double duration = wall_seconds(&job->usage);
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->magic = HISTORY_MAGIC;
+    record->size = size;
+    record->duration_us = (int64_t)(duration * 1e6);
+    record->timestamp = (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000 - record->duration_us;
+    record->status = status;
+    record->line_len = line_len;
+    memcpy(record->line, job->line, line_len);
+
+    if (write(history_fd, record, size) != (ssize_t)size) // one write: appended whole, or not at all
+        perror("-shellman: history: write");
+    free(record);
+}
+
+/* trigram index */
+
+static uint32_t trigram_of(const char *s)
+{
+    return 1u << 24 | (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+static TrigramPostings *lookup_slot(TrigramPostings *table, size_t capacity, uint32_t trigram)
+{
+    size_t mask = capacity - 1;
+    size_t i = (trigram * 2654435761u) & mask;
+
+    while (table[i].trigram != 0 && table[i].trigram != trigram)
+        i = (i + 1) & mask;
+    return &table[i];
+}
+
+static bool grow_index()
+{
+    size_t capacity = index_capacity ? index_capacity * 2 : INDEX_INITIAL_CAPACITY;
+    if (index_bytes + capacity * sizeof(TrigramPostings) > index_max_bytes)
+        return false;
+
+    TrigramPostings *table = (TrigramPostings *)calloc(capacity, sizeof(TrigramPostings));
+    if (table == NULL)
+        return false;
+
+    for (size_t i = 0; i < index_capacity; i++)
+    {
+        if (index_table[i].trigram != 0)
+            *lookup_slot(table, capacity, index_table[i].trigram) = index_table[i];
+    }
+
+    free(index_table);
+    index_bytes += (capacity - index_capacity) * sizeof(TrigramPostings);
+    index_table = table;
+    index_capacity = capacity;
+    return true;
+}
+
+static bool add_posting(uint32_t trigram, uint32_t id)
+{
+    if ((index_count + 1) * 10 > index_capacity * 7 && !grow_index())
+        return false;
+
+    TrigramPostings *postings = lookup_slot(index_table, index_capacity, trigram);
+    if (postings->trigram == 0)
+    {
+        postings->trigram = trigram;
+        index_count++;
+    }
+    else if (postings->count > 0 && postings->ids[postings->count - 1] == id)
+    {
+        return true; // the trigram occurs twice in this line
+    }
+
+    if (postings->count == postings->capacity)
+    {
+        uint32_t capacity = postings->capacity ? postings->capacity * 2 : 4;
+        if (index_bytes + (capacity - postings->capacity) * sizeof(uint32_t) > index_max_bytes)
+            return false;
+        uint32_t *ids = (uint32_t *)realloc(postings->ids, capacity * sizeof(uint32_t));
+        if (ids == NULL)
+            return false;
+        index_bytes += (capacity - postings->capacity) * sizeof(uint32_t);
+        postings->ids = ids;
+        postings->capacity = capacity;
+    }
+    postings->ids[postings->count++] = id;
+    return true;
+}
+
+static void free_index()
+{
+    for (size_t i = 0; i < index_capacity; i++)
+        free(index_table[i].ids);
+    free(index_table);
+    index_table = NULL;
+    index_capacity = index_count = index_bytes = 0;
+}
+
+// Index the records not indexed yet. Return false if the memory cap was reached first.
+static bool index_records()
+{
+    for (; indexed_records < n_records; indexed_records++)
+    {
+        const HistoryRecord *record = history_record(indexed_records);
+        for (uint32_t i = 0; i + 3 <= record->line_len; i++)
+        {
+            if (!add_posting(trigram_of(record->line + i), indexed_records))
+                return false;
+        }
+    }
+    return true;
+}
+
+/* index file */
+
+// Map the index file if it is newer than the one in use, and valid: then its records replace those scanned so far.
+static bool load_index_file()
+{
+    struct stat st, history_st;
+
+    if (index_path[0] == '\0' || stat(index_path, &st) == -1 || fstat(history_fd, &history_st) == -1)
+        return false;
+    if (index_file != NULL && st.st_ino == index_file_ino && st.st_mtim.tv_sec == index_file_mtime.tv_sec &&
+        st.st_mtim.tv_nsec == index_file_mtime.tv_nsec)
+        return false; // the one in use
+    if ((size_t)st.st_size < sizeof(HistoryIndexHeader))
+        return false;
+
+    int fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const HistoryIndexHeader *header = (const HistoryIndexHeader *)map;
+    size_t size = st.st_size;
+    bool valid = header->magic == HISTORY_INDEX_MAGIC && header->version == HISTORY_INDEX_VERSION &&
+                 header->history_dev == (uint64_t)history_st.st_dev &&
+                 header->history_ino == (uint64_t)history_st.st_ino &&
+                 header->scanned_size <= (uint64_t)history_st.st_size && header->n_records <= size / 8 &&
+                 header->n_trigrams <= size / sizeof(IndexedTrigram) && header->n_postings <= size / 4 &&
+                 sizeof(HistoryIndexHeader) + header->n_records * 8 + header->n_trigrams * sizeof(IndexedTrigram) +
+                         header->n_postings * 4 == size &&
+                 header->n_records >= file_records && header->n_records > 0;
+
+    if (valid && (refresh_mapping(), header->scanned_size > mapped_size))
+        valid = false;
+    if (valid)
+    {
+        const uint64_t *new_offsets = (const uint64_t *)(header + 1);
+        uint64_t last = new_offsets[header->n_records - 1];
+        valid = last % 8 == 0 && last + sizeof(HistoryRecord) <= header->scanned_size &&
+                ((const HistoryRecord *)(mapping + last))->magic == HISTORY_MAGIC;
+    }
+    if (!valid)
+    {
+        munmap(map, size);
+        return false;
+    }
+
+    if (index_file != NULL)
+        munmap((void *)index_file, index_file_size);
+    index_file = map;
+    index_file_size = size;
+    index_file_ino = st.st_ino;
+    index_file_mtime = st.st_mtim;
+    file_offsets = (const uint64_t *)(header + 1);
+    file_trigrams = (const IndexedTrigram *)(file_offsets + header->n_records);
+    file_postings = (const uint32_t *)(file_trigrams + header->n_trigrams);
+    file_trigram_count = header->n_trigrams;
+
+    // the records past it are scanned and indexed again from where it stopped
+    file_records = n_records = indexed_records = header->n_records;
+    scanned_size = header->scanned_size;
+    free_index();
+    indexer_started = false;
+    return true;
+}
+
+static const IndexedTrigram *find_file_trigram(uint32_t trigram)
+{
+    size_t low = 0, high = file_trigram_count;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (file_trigrams[middle].trigram < trigram)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < file_trigram_count && file_trigrams[low].trigram == trigram)
+        return &file_trigrams[low];
+    return NULL;
+}
+
+static int compare_postings(const void *a, const void *b)
+{
+    uint32_t x = ((const TrigramPostings *)a)->trigram, y = ((const TrigramPostings *)b)->trigram;
+    return x < y ? -1 : x > y;
+}
+
+static bool write_all(FILE *fp, const void *data, size_t size)
+{
+    return size == 0 || fwrite(data, size, 1, fp) == 1;
+}
+
+// Write a new index file: that in use merged with every record past it. Run in the indexer.
+static bool write_index_file()
+{
+    struct stat history_st;
+    char tmp_path[sizeof(index_path) + 32];
+
+    index_max_bytes = SIZE_MAX; // this process is only the indexer
+    scan_records();
+    if (!index_records() || n_records == 0 || fstat(history_fd, &history_st) == -1)
+        return false;
+
+    // the in-memory trigrams, sorted to merge with those of the index file
+    TrigramPostings *tail = (TrigramPostings *)malloc((index_count + 1) * sizeof(TrigramPostings));
+    if (tail == NULL)
+        return false;
+    size_t n_tail = 0;
+    for (size_t i = 0; i < index_capacity; i++)
+    {
+        if (index_table[i].trigram != 0)
+            tail[n_tail++] = index_table[i];
+    }
+    qsort(tail, n_tail, sizeof(TrigramPostings), compare_postings);
+
+    HistoryIndexHeader header = {HISTORY_INDEX_MAGIC, HISTORY_INDEX_VERSION, history_st.st_dev, history_st.st_ino,
+                                 scanned_size, n_records, 0, 0};
+    size_t common = n_records / HISTORY_COMMON_SHARE;
+
+    // first pass: the merged trigrams and where their postings go
+    size_t capacity = file_trigram_count + n_tail;
+    IndexedTrigram *merged = (IndexedTrigram *)malloc((capacity + 1) * sizeof(IndexedTrigram));
+    if (merged == NULL)
+    {
+        free(tail);
+        return false;
+    }
+    size_t f = 0, t = 0;
+    while (f < file_trigram_count || t < n_tail)
+    {
+        IndexedTrigram *entry = &merged[header.n_trigrams++];
+        bool from_file = t == n_tail || (f < file_trigram_count && file_trigrams[f].trigram <= tail[t].trigram);
+        bool from_tail = f == file_trigram_count || (t < n_tail && tail[t].trigram <= file_trigrams[f].trigram);
+
+        entry->trigram = from_file ? file_trigrams[f].trigram : tail[t].trigram;
+        entry->count = (from_file ? file_trigrams[f].count : 0) + (from_tail ? tail[t].count : 0);
+        if ((from_file && file_trigrams[f].first == HISTORY_INDEX_COMMON) || (entry->count > common && entry->count > COMMON_MIN_COUNT))
+        {
+            entry->first = HISTORY_INDEX_COMMON; // common once, common for good: its old postings are gone
+        }
+        else
+        {
+            entry->first = header.n_postings;
+            header.n_postings += entry->count;
+        }
+        f += from_file;
+        t += from_tail;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", index_path, getpid());
+    FILE *fp = fopen(tmp_path, "w");
+    bool ok = fp != NULL;
+
+    ok = ok && write_all(fp, &header, sizeof(header));
+    ok = ok && write_all(fp, file_offsets, file_records * sizeof(uint64_t));
+    ok = ok && write_all(fp, offsets, (n_records - file_records) * sizeof(uint64_t));
+    ok = ok && write_all(fp, merged, header.n_trigrams * sizeof(IndexedTrigram));
+
+    // second pass: the postings, those of the index file first since its ids are lower
+    f = t = 0;
+    for (size_t i = 0; ok && i < header.n_trigrams; i++)
+    {
+        bool from_file = f < file_trigram_count && file_trigrams[f].trigram == merged[i].trigram;
+        bool from_tail = t < n_tail && tail[t].trigram == merged[i].trigram;
+
+        if (merged[i].first != HISTORY_INDEX_COMMON)
+        {
+            if (from_file)
+                ok = write_all(fp, file_postings + file_trigrams[f].first, file_trigrams[f].count * sizeof(uint32_t));
+            if (ok && from_tail)
+                ok = write_all(fp, tail[t].ids, tail[t].count * sizeof(uint32_t));
+        }
+        f += from_file;
+        t += from_tail;
+    }
+
+    if (fp != NULL && fclose(fp) != 0)
+        ok = false;
+    if (ok && rename(tmp_path, index_path) == -1)
+        ok = false;
+    if (!ok)
+        unlink(tmp_path);
+
+    free(merged);
+    free(tail);
+    return ok;
+}
+
+// Fork a process that writes a new index file at a low priority. At most once until it is adopted.
+static void start_indexer()
+{
+    if (indexer_started || index_path[0] == '\0')
+        return;
+    indexer_started = true;
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("-shellman: history: fork");
+        return;
+    }
+    if (pid > 0)
+        return; // reaped like any unknown child by wait_back_job()
+
+    setpriority(PRIO_PROCESS, 0, 10);
+    _exit(write_index_file() ? 0 : 1);
+}
+
+static void update_index()
+{
+    load_index_file(); // written by an indexer meanwhile
+    scan_records();
+    if (!index_records())
+        start_indexer(); // the memory cap: the rest is scanned until the next index file
+}
+
+/* search */
+
+static bool record_contains(size_t id, const char *needle, size_t needle_len)
+{
+    const HistoryRecord *record = history_record(id);
+    return memmem(record->line, record->line_len, needle, needle_len) != NULL;
+}
+
+static long scan_back(const char *needle, size_t needle_len, size_t from, long before)
+{
+    for (long id = before - 1; id >= (long)from; id--)
+    {
+        if (record_contains(id, needle, needle_len))
+            return id;
+    }
+    return -1;
+}
+
+// Search the records indexed in memory, [file_records, indexed_records), before `before`.
+static long search_memory(const char *needle, size_t needle_len, long before)
+{
+    if (index_count == 0)
+        return -1;
+
+    // the rarest trigram of the needle has the fewest candidates
+    TrigramPostings *rarest = NULL;
+    for (size_t i = 0; i + 3 <= needle_len; i++)
+    {
+        TrigramPostings *postings = lookup_slot(index_table, index_capacity, trigram_of(needle + i));
+        if (postings->trigram == 0)
+            return -1; // some trigram occurs nowhere
+        if (rarest == NULL || postings->count < rarest->count)
+            rarest = postings;
+    }
+
+    for (long i = (long)rarest->count - 1; i >= 0; i--)
+    {
+        if (rarest->ids[i] < before && record_contains(rarest->ids[i], needle, needle_len))
+            return rarest->ids[i];
+    }
+    return -1;
+}
+
+// Search the records of the index file, [0, file_records), before `before`.
+static long search_file(const char *needle, size_t needle_len, long before)
+{
+    const IndexedTrigram *rarest = NULL;
+
+    if (file_records == 0)
+        return -1;
+
+    for (size_t i = 0; i + 3 <= needle_len; i++)
+    {
+        const IndexedTrigram *entry = find_file_trigram(trigram_of(needle + i));
+        if (entry == NULL)
+            return -1;
+        if (entry->first != HISTORY_INDEX_COMMON && (rarest == NULL || entry->count < rarest->count))
+            rarest = entry;
+    }
+    if (rarest == NULL)
+        return scan_back(needle, needle_len, 0, before); // only common trigrams
+
+    const uint32_t *ids = file_postings + rarest->first;
+    for (long i = (long)rarest->count - 1; i >= 0; i--)
+    {
+        if (ids[i] < before && record_contains(ids[i], needle, needle_len))
+            return ids[i];
+    }
+    return -1;
+}
+
+long history_search_back(const char *needle, long before)
+{
+    size_t needle_len = strlen(needle);
+    long id;
+
+    update_index();
+    if (before < 0 || (size_t)before > n_records)
+        before = n_records;
+
+    if (needle_len < 3)
+        return scan_back(needle, needle_len, 0, before);
+
+    // newest first: past the in-memory index (over its cap), in it, then in the index file
+    if (before > (long)indexed_records)
+    {
+        if ((id = scan_back(needle, needle_len, indexed_records, before)) != -1)
+            return id;
+        before = indexed_records;
+    }
+    if (before > (long)file_records)
+    {
+        if ((id = search_memory(needle, needle_len, before)) != -1)
+            return id;
+        before = file_records;
+    }
+    return search_file(needle, needle_len, before);
+}
+
+/* builtin command */
+
+static void print_record(size_t id)
+{
+    const HistoryRecord *record = history_record(id);
+    time_t seconds = record->timestamp / 1000000;
+    char date[32];
+
+    strftime(date, sizeof(date), "%F %T", localtime(&seconds));
+    printf("%6zu  %s  %3d  %9.3fs  %s\n", id + 1, date, record->status, record->duration_us / 1e6, record->line);
+}
+
+void history(char **args)
+{
+    if (history_fd == -1)
+    {
+        printf("-shellman: history: no history file\n");
+        return;
+    }
+
+    size_t size = history_size();
+
+    if (args[0] != NULL && strcmp(args[0], "-s") == 0)
+    {
+        if (args[1] == NULL)
+        {
+            printf("-shellman: history example usage: `history -s make`\n");
+            return;
+        }
+
+        struct timespec start, finish;
+        size_t n_matches = 0;
+        long id = size;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while ((id = history_search_back(args[1], id)) != -1 && n_matches < HISTORY_DEFAULT_LIST)
+        {
+            print_record(id);
+            n_matches++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+
+        fprintf(stderr, "-shellman: history: %zu matches (newest first) in %.3f ms\n", n_matches,
+                (finish.tv_sec - start.tv_sec) * 1e3 + (finish.tv_nsec - start.tv_nsec) / 1e6);
+        return;
+    }
+
+    size_t n = HISTORY_DEFAULT_LIST;
+    if (args[0] != NULL && (n = strtoul(args[0], NULL, 10)) == 0)
+    {
+        printf("-shellman: history example usage: `history 50` or `history -s make`\n");
+        return;
+    }
+
+    for (size_t id = size > n ? size - n : 0; id < size; id++)
+        print_record(id);
+}
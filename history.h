@@ -0,0 +1,111 @@
+#ifndef history_h
+#define history_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HISTORY_MAGIC 0x54534948 // "HIST"
+#define HISTORY_FILE_NAME ".shellman_history"
+#define HISTORY_DEFAULT_LIST 16
+
+#define HISTORY_INDEX_MAGIC 0x58444948 // "HIDX"
+#define HISTORY_INDEX_VERSION 1
+#define HISTORY_INDEX_SUFFIX ".idx"
+#define HISTORY_INDEX_LAG_BYTES (256 << 10) // of the file past its index file that start an indexer
+#define HISTORY_TAIL_MAX_BYTES (16 << 20)   // of postings kept in memory for the records past the index file
+#define HISTORY_COMMON_SHARE 8              // a trigram in more than 1/8 of the records keeps no postings
+#define HISTORY_INDEX_COMMON UINT64_MAX
+
+/**
+ *
+ * Persistent command history: $SHELLMAN_HISTFILE, or ~/.shellman_history.
+ *
+ * The file is a sequence of 8-byte aligned records, never rewritten. A record is
+ * appended with a single write() on an O_APPEND descriptor, so several shells can
+ * share one file: the kernel serializes the writes and each lands whole at the end.
+ * A record cut short by a crash is skipped by scanning for the next magic number.
+ *
+ * The file is read through a read-only shared mapping, which is remapped when
+ * another shell made it grow. A trigram index (trigram -> ids of the records
+ * containing it) serves searches: they walk the postings of the query's rarest
+ * trigram and check each candidate with memmem(), so they cost in proportion to
+ * the matches, not to the size of the file. Queries shorter than 3 bytes are
+ * scanned.
+ *
+ * The index of most of the file persists next to it, in HISTFILE.idx: a
+ * HistoryIndexHeader, the offsets of its records, its trigrams sorted, and
+ * their postings. It is mapped read-only, so a new shell searches a file of
+ * millions of records at once, and its page cache is shared by every shell. An
+ * interactive shell whose index file is missing, stale, or more than
+ * HISTORY_INDEX_LAG_BYTES behind the history forks an indexer at startup; the
+ * indexer merges the new records into a new index file, written aside and
+ * renamed over the old one, at a low priority. So does a shell whose own index
+ * fills up. A search picks up a newer index file when there is one.
+ *
+ * Records past the index file are indexed in memory as they are searched, up to
+ * HISTORY_TAIL_MAX_BYTES of postings; the rest is scanned until the next index
+ * file covers it. A trigram found in more than 1/HISTORY_COMMON_SHARE of the
+ * records of an index file keeps no postings there: it would not narrow a
+ * search down, and the most common trigrams hold most of the postings. A query
+ * made only of such trigrams scans that part of the history.
+ *
+**/
+typedef struct historyrecord
+{
+    uint32_t magic;
+    uint32_t size;       // of the whole record, header and padding included
+    int64_t timestamp;   // start, in microseconds since the epoch
+    int64_t duration_us; // wall time
+    int32_t status;      // exit status, 128+N for signal N, 127 if nothing could be launched
+    uint32_t line_len;
+    char line[];         // line_len bytes and a NUL
+} HistoryRecord;
+
+typedef struct historyindexheader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t history_dev; // of the history file it indexes
+    uint64_t history_ino;
+    uint64_t scanned_size; // of the history file, split into the records below
+    uint64_t n_records;
+    uint64_t n_trigrams;
+    uint64_t n_postings;
+    // uint64_t offsets[n_records], IndexedTrigram trigrams[n_trigrams], uint32_t postings[n_postings]
+} HistoryIndexHeader;
+
+typedef struct indexedtrigram
+{
+    uint32_t trigram;
+    uint32_t count;  // records containing it
+    uint64_t first;  // of its postings, or HISTORY_INDEX_COMMON if it has none
+} IndexedTrigram;
+
+typedef struct trigrampostings
+{
+    uint32_t trigram; // 0 if the slot is empty
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *ids; // record ids, ascending and without duplicates
+} TrigramPostings;
+
+struct job;
+
+// Open the history file. Without it every other call is a no-op.
+void init_history();
+// Append the line of a job that is over, with its exit status and wall time.
+void record_history(struct job *job);
+// Number of records, including those appended by other shells.
+size_t history_size();
+// Record id, or NULL if out of range.
+const HistoryRecord *history_record(size_t id);
+// Id of the newest record before `before` whose line contains needle, or -1.
+long history_search_back(const char *needle, long before);
+
+void history(char **args);
+
+#endif
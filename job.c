@@ -1,63 +1,175 @@
 #include "job.h"
+#include "admit.h"
+#include "benchmark.h"
+#include "heredoc.h"
+#include "history.h"
+#include "parallel.h"
+#include "parsecache.h"
+#include "pipemon.h"
+#include "place.h"
+#include "server.h"
+#include "stats.h"
 
-int set_jobid()
+Job *new_job(size_t byte_size)
 {
-    Job *cur_job;
-    int max = 0;
-    for (cur_job = shell->jobs; cur_job != NULL; cur_job = cur_job->next)
+    // Size the first chunk so that a job with a short pipeline fits in a single allocation.
+    Arena *arena = new_arena(sizeof(Job) + 4 * sizeof(Process) + byte_size * 2 + 4 * ARENA_ALIGNMENT);
+    if (arena == NULL)
+        return NULL;
+
+    Job *new_job = (Job *)arena_alloc(arena, sizeof(Job));
+
+    new_job->arena = arena;
+    new_job->job_mode = FORE_MODE;
+    new_job->job_state = Pending;
+    new_job->line = (char *)arena_alloc(arena, byte_size * 2); // line and strings share one allocation
+    new_job->strings = new_job->line + byte_size;
+    new_job->running_procs = 0;
+    new_job->process_queue = (Process *)arena_alloc(arena, sizeof(Process));
+
+    return new_job;
+}
+
+// Point at the copy's own bytes of a string of the source job, which lives in its strings.
+static char *relocate(const Job *source, Job *copy, const char *string)
+{
+    return string != NULL ? copy->strings + (string - source->strings) : NULL;
+}
+
+Job *copy_job(const Job *source)
+{
+    size_t byte_size = source->strings - source->line; // line and strings share one allocation
+    Job *copy = new_job(byte_size);
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy->line, source->line, byte_size * 2);
+    copy->job_mode = source->job_mode;
+    copy->background = source->background;
+    copy->timed = source->timed;
+
+    Process *cur_process = copy->process_queue;
+    for (const Process *process = source->process_queue; process != NULL; process = process->next)
     {
-        if (max < cur_job->id)
+        if (process != source->process_queue && (cur_process = new_process(copy->arena, cur_process)) == NULL)
+            goto FAILED;
+
+        cur_process->cmd = relocate(source, copy, process->cmd);
+        cur_process->read_filepath = relocate(source, copy, process->read_filepath);
+        cur_process->write_filepath = relocate(source, copy, process->write_filepath);
+        cur_process->here_delimiter = relocate(source, copy, process->here_delimiter);
+        if (process->here_body != NULL) // in the arena, not in the strings
+        {
+            if ((cur_process->here_body = (char *)arena_alloc(copy->arena, process->here_size)) == NULL)
+                goto FAILED;
+            memcpy(cur_process->here_body, process->here_body, process->here_size);
+            cur_process->here_size = process->here_size;
+        }
+        for (size_t i = 0; i < process->n_args; i++)
         {
-            max = cur_job->id;
+            if (!push_arg(copy->arena, cur_process, relocate(source, copy, process->args[i])))
+                goto FAILED;
         }
     }
+    cur_process->next = NULL;
+    return copy;
 
-    return max + 1;
+FAILED:
+    free_job(copy);
+    return NULL;
 }
 
-Job *new_job(size_t byte_size)
+Job *copy_rest_of_line(const Job *job, size_t n_words, size_t *line_offset)
 {
-    Job *new_job = (Job *)calloc(1, sizeof(Job));
-    if (new_job == NULL)
+    Job *copy = copy_job(job);
+    if (copy == NULL)
         return NULL;
 
-    new_job->id = set_jobid();
-    new_job->job_mode = FORE_MODE;
-    new_job->job_state = Pending;
-    new_job->line = (char *)calloc(byte_size, sizeof(char));
-    new_job->running_procs = 0;
-    new_job->process_queue = (Process *)calloc(1, sizeof(Process));
+    Process *first = copy->process_queue;
+    first->args += n_words;
+    first->n_args -= n_words;
+    first->args_capacity -= n_words;
+    first->cmd = first->args[0];
+    copy->job_mode = FORE_MODE;
+    copy->timed = false;
+    *line_offset = first->cmd - copy->strings;
+    return copy;
+}
 
-    return new_job;
+void free_job(Job *job)
+{
+    if (job->edges != NULL)
+        free_pipe_edges(job); // a mapping of its own, shared with the relays
+    free_arena(job->arena); // releases the job itself, its line and all of its processes
+}
+
+static int n_running_back_jobs = 0;
+static int n_running_procs = 0;
+
+// Bring the running counts in line with a change of the job's state, listing or processes.
+// Its mode only changes while it is not Running.
+static void count_running(Job *job)
+{
+    bool running = job->listed && job->job_state == Running;
+    bool back = running && job->job_mode == BACK_MODE;
+    int procs = running ? job->running_procs : 0;
+
+    n_running_back_jobs += back - job->counted_back;
+    n_running_procs += procs - job->counted_procs;
+    job->counted_back = back;
+    job->counted_procs = procs;
 }
 
+int running_back_jobs()
+{
+    return n_running_back_jobs;
+}
+
+int running_processes()
+{
+    return n_running_procs;
+}
+
+// Only jobs in the job list get an id; builtin jobs and jobs that failed to parse keep 0.
 void insert_job(Job *new_job)
 {
+    new_job->id = alloc_jobid();
+    register_job(new_job);
+
+    new_job->listed = true;
+    count_job_state(-1, new_job->job_state);
+    count_running(new_job);
+
+    new_job->prev = NULL;
     new_job->next = shell->jobs;
+    if (shell->jobs != NULL)
+        shell->jobs->prev = new_job;
     shell->jobs = new_job;
 }
 
 void delete_job(int job_id)
 {
-    Job *cur_job = NULL, *prev_job = NULL;
+    Job *job = find_job(job_id);
+    Process *cur_proc;
 
-    for (cur_job = shell->jobs; cur_job != NULL; cur_job = cur_job->next)
-    {
-        if (cur_job->id == job_id)
-        {
-            if (prev_job == NULL)
-            {
-                shell->jobs = cur_job->next;
-                cur_job->next = NULL;
-                break;
-            }
+    if (job == NULL)
+        return;
 
-            prev_job->next = cur_job->next;
-            cur_job->next = NULL;
-            break;
-        }
-        prev_job = cur_job;
-    }
+    if (job->prev != NULL)
+        job->prev->next = job->next;
+    else
+        shell->jobs = job->next;
+    if (job->next != NULL)
+        job->next->prev = job->prev;
+    job->prev = NULL;
+    job->next = NULL;
+    job->listed = false;
+    count_job_state(job->job_state, -1);
+    count_running(job);
+
+    for (cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+        unregister_process(cur_proc);
+    unregister_job(job);
 }
 
 void insert_finished_job(Job *finished_job)
@@ -70,19 +182,101 @@ void insert_finished_job(Job *finished_job)
 
     finished_job->next = shell->finished_jobs;
     shell->finished_jobs = finished_job;
+    finished_job->listed = true;
+    count_job_state(-1, finished_job->job_state);
+}
+
+void set_job_state(Job *job, JobState state)
+{
+    if (job->listed && job->job_state != state)
+        count_job_state(job->job_state, state);
+    job->job_state = state;
+    count_running(job);
+}
+
+// Print the usage of a `time` job, and of each stage if it is a pipeline.
+static void print_time_report(Job *job)
+{
+    fprintf(stderr, "time: ");
+    print_usage(stderr, &job->usage);
+    fprintf(stderr, "\n");
+
+    if (job->process_queue->next == NULL)
+        return;
+
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+    {
+        if (cur_proc->pid == 0)
+            continue; // never launched
+        fprintf(stderr, "  %-12s ", cur_proc->cmd);
+        print_usage(stderr, &cur_proc->usage);
+        fprintf(stderr, "\n");
+    }
+}
+
+// Move a job whose processes have all terminated from the job list to the finished list.
+void finish_job(Job *job)
+{
+    if (job->job_state != Killed)
+    {
+        set_job_state(job, Done);
+    }
+    count_finished(job->job_state == Killed);
+    if (job->timed)
+        print_time_report(job);
+    if (job->edges != NULL)
+    {
+        fprintf(stderr, "pipes: %s\n", job->line);
+        print_pipe_edges(stderr, job);
+    }
+    if (shell->interactive && job->pool == NULL && !job->no_history)
+        record_history(job);
+    delete_job(job->id);
+    insert_finished_job(job);
+    if (job->request != NULL)
+        request_done(job);
+    if (job->pool != NULL)
+        pool_task_done(job);
 }
 
 /* builtin commands */
 
+// One line per process for `jobs -l`: pid, state, command and what it has cost so far.
+static void print_processes(Job *job)
+{
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+    {
+        char *state;
+        if (cur_proc->pid == 0)
+            state = "NotRun";
+        else if (cur_proc->usage.end.tv_sec == 0 && cur_proc->usage.end.tv_nsec == 0)
+            state = WIFSTOPPED(cur_proc->status) ? "Stopped" : "Running";
+        else
+            state = WIFSIGNALED(cur_proc->status) ? "Killed" : "Done";
+
+        printf("    %7d %-7s %-12s ", cur_proc->pid, state, cur_proc->cmd);
+        print_usage(stdout, &cur_proc->usage);
+        if (job->placement != NULL)
+            print_stage_cpus(stdout, cur_proc);
+        printf("\n");
+    }
+}
+
 void jobs(char **args)
 {
     Job *cur_job;
     char state[8];
+    bool long_format = args[0] != NULL && strcmp(args[0], "-l") == 0;
+    bool pipe_format = args[0] != NULL && strcmp(args[0], "-p") == 0;
 
     for (cur_job = shell->jobs; cur_job != NULL; cur_job = cur_job->next)
     {
         switch (cur_job->job_state)
         {
+        case Pending:
+            strcpy(state, "Pending");
+            break;
+
         case Running:
             strcpy(state, "Running");
             break;
@@ -103,34 +297,47 @@ void jobs(char **args)
             break;
         }
 
-        printf("[%d] %s %s\n", cur_job->id, state, cur_job->line);
+        printf("[%d] %s %s", cur_job->id, state, cur_job->line);
+        if (cur_job->placement != NULL)
+            print_placement(stdout, cur_job);
+        printf("\n");
+        if (long_format)
+            print_processes(cur_job);
+        if (pipe_format && cur_job->edges != NULL)
+            print_pipe_edges(stdout, cur_job);
     }
 }
 
 void fg(char **args)
 {
-    if (args == NULL)
+    if (args == NULL || args[0] == NULL)
     {
         printf("-shellman: fg example usage: `fg <job-id>`\n");
         return;
     }
 
-    Job *cur_job;
-    for (cur_job = shell->jobs; cur_job != NULL; cur_job = cur_job->next)
+    Job *cur_job = find_job(atoi(args[0]));
+    if (cur_job != NULL && dequeue_job(cur_job))
     {
-        if (cur_job->id == atoi(args[0]) && cur_job->job_state == Stopped)
+        shell->cur_job = cur_job;
+        cur_job->job_mode = FORE_MODE;
+        printf("fg [%d] %s\n", cur_job->id, cur_job->line);
+        run_job(cur_job); // past the admission limits: the user asked for it
+        set_job_state(cur_job, Running);
+        return;
+    }
+    if (cur_job != NULL && cur_job->job_state == Stopped)
+    {
+        shell->cur_job = cur_job;
+        shell->cur_job->job_mode = FORE_MODE;
+        kill(-shell->cur_job->pgid, SIGCONT);
+        if (shell->interactive && tcsetpgrp(STDIN_FILENO, shell->cur_job->pgid) == -1)
         {
-            shell->cur_job = cur_job;
-            shell->cur_job->job_mode = FORE_MODE;
-            kill(-shell->cur_job->pgid, SIGCONT);
-            if (tcsetpgrp(STDIN_FILENO, shell->cur_job->pgid) == -1)
-            {
-                perror("tcsetpgrp");
-            }
-
-            printf("fg [%d] %s\n", shell->cur_job->id, shell->cur_job->line);
-            return;
+            perror("tcsetpgrp");
         }
+
+        printf("fg [%d] %s\n", shell->cur_job->id, shell->cur_job->line);
+        return;
     }
 
     printf("-shellman: no job id: %d.\n", atoi(args[0]));
@@ -138,23 +345,32 @@ void fg(char **args)
 
 void bg(char **args)
 {
-    if (args == NULL)
+    if (args == NULL || args[0] == NULL)
     {
         printf("-shellman: bg example usage: `bg <job-id>`\n");
         return;
     }
 
-    Job *cur_job;
-    for (cur_job = shell->jobs; cur_job != NULL; cur_job = cur_job->next)
+    Job *cur_job = find_job(atoi(args[0]));
+    if (cur_job != NULL && dequeue_job(cur_job))
     {
-        if (cur_job->id == atoi(args[0]) && cur_job->job_state == Stopped)
+        run_job(cur_job); // past the admission limits: the user asked for it
+        if (cur_job->running_procs == 0)
         {
-            shell->cur_job = cur_job;
-            shell->cur_job->job_mode = BACK_MODE;
-            kill(-shell->cur_job->pgid, SIGCONT);
-            printf("bg [%d] %s\n", shell->cur_job->id, shell->cur_job->line);
+            finish_job(cur_job);
             return;
         }
+        set_job_state(cur_job, Running);
+        printf("bg [%d] %d %s\n", cur_job->id, cur_job->pgid, cur_job->line);
+        return;
+    }
+    if (cur_job != NULL && cur_job->job_state == Stopped)
+    {
+        shell->cur_job = cur_job;
+        shell->cur_job->job_mode = BACK_MODE;
+        kill(-shell->cur_job->pgid, SIGCONT);
+        printf("bg [%d] %s\n", shell->cur_job->id, shell->cur_job->line);
+        return;
     }
 
     printf("-shellman: no job id: %d.\n", atoi(args[0]));
@@ -164,34 +380,139 @@ void run_command(Process *command)
 {
     if (strcmp(command->cmd, "jobs") == 0)
     {
-        jobs(command->args);
+        jobs(command->args + 1);
     }
     else if (strcmp(command->cmd, "fg") == 0)
     {
-        fg(command->args);
+        fg(command->args + 1);
     }
     else if (strcmp(command->cmd, "bg") == 0)
     {
-        bg(command->args);
+        bg(command->args + 1);
+    }
+    else if (strcmp(command->cmd, "hash") == 0)
+    {
+        hash(command->args + 1);
+    }
+    else if (strcmp(command->cmd, "spawn") == 0)
+    {
+        spawn(command->args + 1);
+    }
+    else if (strcmp(command->cmd, "parallel") == 0)
+    {
+        parallel(command);
+    }
+    else if (strcmp(command->cmd, "xargs") == 0)
+    {
+        xargs(command);
+    }
+    else if (strcmp(command->cmd, "history") == 0)
+    {
+        history(command->args + 1);
+    }
+    else if (strcmp(command->cmd, "parsecache") == 0)
+    {
+        parsecache(command->args + 1);
+    }
+    else if (strcmp(command->cmd, "bench") == 0)
+    {
+        bench(command);
+    }
+    else if (strcmp(command->cmd, "pipes") == 0)
+    {
+        pipes(command);
+    }
+    else if (strcmp(command->cmd, "place") == 0)
+    {
+        place(command);
+    }
+    else if (strcmp(command->cmd, "admit") == 0)
+    {
+        admit(command);
+    }
+    else if (strcmp(command->cmd, "shellstat") == 0)
+    {
+        shellstat(command->args + 1);
     }
 }
 
 /* builtin commands end here. */
 
+// Run a builtin under `time`: it costs the shell itself, plus the children it reaps (e.g. parallel).
+static void run_timed_command(Job *job)
+{
+    struct rusage self_before, self_after, children_before, children_after;
+
+    start_usage(&job->usage);
+    getrusage(RUSAGE_SELF, &self_before);
+    getrusage(RUSAGE_CHILDREN, &children_before);
+
+    run_command(job->process_queue);
+
+    getrusage(RUSAGE_SELF, &self_after);
+    getrusage(RUSAGE_CHILDREN, &children_after);
+
+    Usage self = {0}, children = {0};
+    diff_usage(&self, &self_before, &self_after);
+    diff_usage(&children, &children_before, &children_after);
+    children.start = self.start = job->usage.start;
+    add_usage(&job->usage, &self);
+    add_usage(&job->usage, &children);
+
+    fprintf(stderr, "time: ");
+    print_usage(stderr, &job->usage);
+    fprintf(stderr, "\n");
+}
+
+// Close what a process that will not be launched was to read and write: the pipe from the previous
+// process, a file, or a descriptor the caller handed in (e.g. the output capture of a daemon request).
+static void skip_process(Process *process)
+{
+    if (process->read_fd)
+        close(process->read_fd);
+    if (process->write_fd)
+        close(process->write_fd);
+    process->read_fd = process->write_fd = 0;
+}
+
 void run_job(Job *job)
 {
     pid_t pid;
 
+    count_command();
     if (job->job_mode == BUILTIN_MODE)
     {
-        run_command(job->process_queue);
+        job->process_queue->job = job; // lets a builtin see how it was started
+        if (job->timed)
+        {
+            run_timed_command(job);
+        }
+        else
+        {
+            start_usage(&job->usage);
+            run_command(job->process_queue);
+            clock_gettime(CLOCK_MONOTONIC, &job->usage.end); // for the history
+        }
         return;
     }
 
+    start_usage(&job->usage);
+
     Process *process;
-    for (process = job->process_queue; process != NULL; process = process->next)
+    size_t edge = 0; // the pipe after the process
+    for (process = job->process_queue; process != NULL; process = process->next, edge++)
     {
         int read_fd = 0, write_fd = 0;
+
+        // Resolve in the parent so that the result stays in the cache for the next command.
+        const char *path = is_stage_builtin(process->cmd) ? process->cmd : resolve_command(process->cmd);
+        if (path == NULL)
+        {
+            printf("-shellman: %s: command not found\n", process->cmd);
+            count_exec_failure();
+            skip_process(process);
+            continue;
+        }
         if (process->read_filepath != NULL)
         {
             if (read_fd != 0)
@@ -201,11 +522,24 @@ void run_job(Job *job)
             {
                 perror("-shellman: open");
                 printf("-shellman: filepath is :%s", process->read_filepath);
+                skip_process(process);
                 continue;
             }
             process->read_fd = read_fd;
         }
 
+        if (process->here_body != NULL)
+        {
+            if (process->read_fd)
+                close(process->read_fd); // the here-document wins over a pipe, as the file of `<` does
+            if ((process->read_fd = here_document_fd(process->here_body, process->here_size)) == -1)
+            {
+                process->read_fd = 0;
+                skip_process(process);
+                continue;
+            }
+        }
+
         if (process->write_filepath != NULL)
         {
             if (write_fd != 0)
@@ -215,187 +549,231 @@ void run_job(Job *job)
             {
                 perror("-shellman: open\n");
                 printf("-shellman: filepath is :%s", process->write_filepath);
+                skip_process(process);
                 continue;
             }
             process->write_fd = write_fd;
         }
 
         if (process->next)
-        {
-            int pipe_fd[2];
-            pipe(pipe_fd);
-            process->write_fd = pipe_fd[1];
-            process->next->read_fd = pipe_fd[0];
-        }
+            open_stage_pipe(job, process, edge);
 
-        pid = fork();
+        process->job = job; // before the spawn: the child may need its job's placement
+        start_usage(&process->usage);
+        uint64_t start = trace_clock();
+        pid = spawn_process(process, path, job->pgid);
+        trace_span(spawn_mode_name(), start, process->cmd);
+        count_spawn(spawn_latency_ns(&process->usage), pid);
 
-        if (pid == -1)
+        if (process->read_fd)
         {
-            perror("-shellman: fork\n");
+            if (close(process->read_fd) == -1)
+            {
+                perror("-shellman: close\n");
+                break;
+            }
         }
-        else if (pid == 0)
+        if (process->write_fd)
         {
-            set_default();
-
-            if (process->read_fd)
+            if (close(process->write_fd) == -1)
             {
-                if (dup2(process->read_fd, STDIN_FILENO) == -1)
-                {
-                    perror("-shellman: dup2\n");
-                    exit(1);
-                }
-                if (close(process->read_fd) == -1)
-                {
-                    perror("-shellman: close\n");
-                    exit(1);
-                }
+                perror("-shellman: close\n");
+                break;
             }
+        }
 
-            if (process->write_fd)
-            {
-                if (dup2(process->write_fd, STDOUT_FILENO) == -1)
-                {
-                    perror("-shellman: dup2\n");
-                    exit(1);
-                }
-                if (close(process->write_fd) == -1)
-                {
-                    perror("-shellman: close\n");
-                    exit(1);
-                }
-            }
+        if (pid == -1)
+            continue;
 
-            if (execv(process->cmd, process->args) == -1)
+        process->pid = pid;
+        register_process(process);
+        watch_process(process);
+
+        start = trace_clock();
+        if (!job->pgid)
+        {
+            if (setpgid(pid, pid) == -1 && errno != EACCES) // EACCES: the child has already called setpgid() and exec'd
             {
-                perror("-shellman: exec");
-                exit(1); // Exited with error
+                perror("-shellman: setpgid\n");
+                break;
             }
-            exit(0);
+            job->pgid = pid;
         }
         else
         {
-            if (process->read_fd)
+            if (setpgid(pid, job->pgid) == -1 && errno != EACCES)
             {
-                if (close(process->read_fd) == -1)
-                {
-                    perror("-shellman: close\n");
-                    break;
-                }
-            }
-            if (process->write_fd)
-            {
-                if (close(process->write_fd) == -1)
-                {
-                    perror("-shellman: close\n");
-                    break;
-                }
-            }
-
-            process->pid = pid;
-            if (!job->pgid)
-            {
-                if (setpgid(pid, pid) == -1)
-                {
-                    perror("-shellman: setpgid\n");
-                    break;
-                }
-                job->pgid = pid;
-            }
-            else
-            {
-                if (setpgid(pid, job->pgid) == -1)
-                {
-                    perror("-shellman: setpgid\n");
-                    break;
-                }
+                perror("-shellman: setpgid\n");
+                break;
             }
+        }
+        trace_span("setpgid", start, process->cmd);
 
-            job->running_procs++;
+        job->running_procs++;
+        count_running(job);
 
-            if (job->job_mode == FORE_MODE && job->pgid == pid)
+        if (shell->interactive && job->job_mode == FORE_MODE && job->pgid == pid)
+        {
+            start = trace_clock();
+            int err = tcsetpgrp(STDIN_FILENO, job->pgid);
+            trace_span("tcsetpgrp", start, NULL);
+            if (err == -1)
             {
-                if (tcsetpgrp(STDIN_FILENO, shell->cur_job->pgid) == -1)
-                {
-                    perror("-shellman: tcsetpgrp\n");
-                    break;
-                }
+                perror("-shellman: tcsetpgrp\n");
+                break;
             }
         }
     }
+
+    if (job->edges != NULL)
+        start_relays(job); // after the stages, so that none of them holds a relay's end of a pipe
+}
+
+int exit_status(const Job *job)
+{
+    const Process *last = job->process_queue;
+    while (last->next != NULL)
+        last = last->next;
+
+    if (last->pid == 0)
+        return 127;
+    if (WIFSIGNALED(last->status))
+        return 128 + WTERMSIG(last->status);
+    return WEXITSTATUS(last->status);
+}
+
+void launch_job(Job *job)
+{
+    job->job_mode = job->background || shell->serving ? BACK_MODE : FORE_MODE;
+    job->no_history = true; // the line of the builtin that launched it is the one in the history
+    if (shell->serving)
+        adopt_job(job); // answers the request of the builtin
+
+    insert_job(job);
+    if (job->job_mode == BACK_MODE && queue_job(job))
+        return; // launched by admit_jobs() once the limits allow
+    run_job(job);
+    if (job->running_procs == 0) // nothing could be launched
+    {
+        finish_job(job);
+        return;
+    }
+
+    set_job_state(job, Running);
+    if (job->job_mode == BACK_MODE)
+    {
+        printf("[%d] %d %s\n", job->id, job->pgid, job->line);
+        return;
+    }
+
+    wait_fore_job(job);
+    if (shell->interactive && tcsetpgrp(STDIN_FILENO, getpgid((pid_t)0)) == -1)
+        perror("tcsetpgrp");
+}
+
+// Record a status change of a process reported by wait4(); rusage is only read once it has terminated.
+static bool record_process_status(Job *job, Process *process, int status, const struct rusage *rusage)
+{
+    process->status = status;
+
+    if (WIFSTOPPED(status))
+    {
+        if (job->job_state == Stopped)
+            return false;
+
+        set_job_state(job, Stopped);
+        return true;
+    }
+    else if (WIFCONTINUED(status))
+    {
+        set_job_state(job, Running);
+        return false;
+    }
+
+    if (WIFSIGNALED(status) && (WTERMSIG(status) == SIGKILL || WTERMSIG(status) == SIGTERM))
+    {
+        kill(-job->pgid, SIGKILL);
+        set_job_state(job, Killed);
+    }
+
+    end_usage(&process->usage, rusage);
+    add_usage(&job->usage, &process->usage);
+    count_reaped();
+
+    unwatch_process(process);
+    unregister_process(process);
+    job->running_procs--;
+    count_running(job);
+
+    if (job->running_procs == 0)
+    {
+        finish_job(job);
+        return job->pool == NULL; // tasks of a parallel pool are summed up by the pool
+    }
+    return false;
+}
+
+// Return true if the change is worth a notice in the background ("Stopped" or the job is over).
+bool update_process_status(Job *job, Process *process, int status, const struct rusage *rusage)
+{
+    uint64_t start = trace_clock();
+    bool notice = record_process_status(job, process, status, rusage);
+    trace_span("reap", start, process->cmd);
+    return notice;
+}
+
+void print_notice(Job *job)
+{
+    char *state = job->job_state == Stopped ? "Stopped" : job->job_state == Killed ? "Killed"
+                                                                                   : "Done";
+    printf("[%d] %s %s\n", job->id, state, job->line);
 }
 
 void wait_fore_job(Job *job)
 {
     pid_t wpid;
     int status;
-    Process *cur_proc;
+    struct rusage rusage;
+    Process *wait_proc;
 
-    while (1)
+    while (job->running_procs > 0)
     {
-        if ((wpid = waitpid(-1, &status, WUNTRACED)) == -1)
+        // Wait only for this job's process group so that statuses of background jobs are left for wait_back_job().
+        if ((wpid = wait4(-job->pgid, &status, WUNTRACED, &rusage)) == -1)
         {
+            if (errno == EINTR)
+                continue;
             if (errno != ECHILD)
                 perror("-shellman: waitpid");
             break; // break the loop if all child processes are terminated.
         }
 
-        for (cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
-        {
-            if (cur_proc->pid == wpid)
-            {
-                if (WIFEXITED(status))
-                {
-                    job->running_procs--;
-                }
-                else if (WIFSTOPPED(status))
-                {
-                    job->job_state = Stopped;
-                    printf("[%d] Stopped %s\n", job->id, job->line);
-                    return;
-                }
-                else if (WTERMSIG(status) == SIGINT)
-                {
-                    job->running_procs--;
-                }
-                else if (WTERMSIG(status) == SIGKILL || WTERMSIG(status) == SIGTERM)
-                {
-                    if (job->job_state == Killed)
-                    {
-                        kill(-job->pgid, SIGKILL);
-                        job->job_state = Killed;
-                    }
-
-                    job->running_procs--;
-                }
-                break;
-            }
-        }
+        if ((wait_proc = find_process(wpid)) == NULL || wait_proc->job != job)
+            continue;
 
-        if (job->running_procs == 0)
+        if (update_process_status(job, wait_proc, status, &rusage) && job->job_state == Stopped)
         {
-            if (job->job_state != Killed)
-            {
-                job->job_state = Done;
-            }
-            delete_job(job->id);
-            insert_finished_job(job);
-            break;
+            print_notice(job);
+            return;
         }
     }
+
+    if (job->running_procs == 0 && job->job_state != Done && job->job_state != Killed)
+    {
+        finish_job(job);
+    }
 }
 
-void wait_back_job()
+int wait_back_job()
 {
     pid_t wpid;
-    int status;
-
-    Job *cur_job = NULL, *next_job = NULL, *wait_job = NULL;
-    Process *cur_proc = NULL;
+    int status, n_notices = 0;
+    struct rusage rusage;
+    Process *wait_proc = NULL;
 
     while (1)
     {
-        if ((wpid = waitpid(-1, &status, WUNTRACED | WNOHANG)) == -1)
+        if ((wpid = wait4(-1, &status, WUNTRACED | WNOHANG, &rusage)) == -1)
         {
             if (errno != ECHILD)
                 perror("-shellman: waitpid");
@@ -403,89 +781,51 @@ void wait_back_job()
         }
         else if (wpid == 0)
         {
-            return; // finish the loop if there is no process which has changed the state.
+            break; // finish the loop if there is no process which has changed the state.
         }
 
-        for (cur_job = shell->jobs; cur_job != NULL; cur_job = next_job)
-        {
-            next_job = cur_job->next; // set next_job here because if cur_job is finished, cur_job->next will be changed.
-            for (cur_proc = cur_job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
-            {
-                if (wpid == cur_proc->pid)
-                {
-                    wait_job = cur_job;
-                    goto FINISH_SEARCH;
-                }
-            }
-        }
+        if ((wait_proc = find_process(wpid)) == NULL)
+            continue;
 
-    FINISH_SEARCH:
-        if (WIFEXITED(status))
+        if (update_process_status(wait_proc->job, wait_proc, status, &rusage))
         {
-            wait_job->running_procs--;
+            print_notice(wait_proc->job);
+            n_notices++;
         }
-        else if (WIFSTOPPED(status))
-        {
-            if (wait_job->job_state == Stopped)
-                continue;
+    }
 
-            wait_job->job_state = Stopped;
-            printf("[%d] Stopped %s\n", wait_job->id, wait_job->line);
-        }
-        else if (WTERMSIG(status) == SIGINT)
-        {
-            wait_job->running_procs--;
-        }
-        else if (WTERMSIG(status) == SIGKILL || WTERMSIG(status) == SIGTERM)
-        {
-            kill(-wait_job->pgid, SIGKILL);
-            wait_job->job_state = Killed;
-            wait_job->running_procs--;
-        }
+    return n_notices;
+}
 
-        if (wait_job->running_procs == 0)
-        {
-            if (wait_job->job_state != Killed)
-            {
-                wait_job->job_state = Done;
-            }
-            delete_job(wait_job->id);
-            insert_finished_job(wait_job);
-            printf("[%d] Done %s\n", wait_job->id, wait_job->line);
-        }
+int reap_process(Process *process)
+{
+    int status;
+    struct rusage rusage;
+    pid_t wpid;
+
+    while ((wpid = wait4(process->pid, &status, WUNTRACED | WNOHANG, &rusage)) == -1 && errno == EINTR)
+        ;
+    if (wpid <= 0)
+        return 0; // already reaped by wait_fore_job() or wait_back_job()
+
+    if (update_process_status(process->job, process, status, &rusage))
+    {
+        print_notice(process->job);
+        return 1;
     }
+    return 0;
 }
 
 void free_jobs()
 {
     Job *cur_job, *next_job = NULL;
-    Process *cur_proc, *next_proc = NULL;
     for (cur_job = shell->finished_jobs; cur_job != NULL; cur_job = next_job)
     {
-        for (cur_proc = cur_job->process_queue; cur_proc != NULL; cur_proc = next_proc)
-        {
-            free_string(cur_proc->cmd);
-            free_string(cur_proc->read_filepath);
-            free_string(cur_proc->write_filepath);
-            for (size_t i = 0; i < MAX_ARG_SIZE; i++)
-            {
-                if (cur_proc->args[i] == NULL)
-                {
-                    break;
-                }
-                free_string(cur_proc->args[i]);
-            }
-
-            next_proc = cur_proc->next;
-            free(cur_proc);
-            cur_proc = NULL;
-        }
-
-        free_string(cur_job->line);
-
         next_job = cur_job->next;
-        free(cur_job);
+        count_job_state(cur_job->job_state, -1);
+        free_job(cur_job);
         cur_job = NULL;
     }
     shell->finished_jobs = cur_job; // initialize finished_jobs with NULL
+    publish_stats();
 }
@@ -7,9 +7,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "event.h"
+#include "jobtable.h"
+#include "path.h"
 #include "process.h"
+#include "spawn.h"
+#include "trace.h"
 #include "util.h"
 
 /**
@@ -39,15 +47,38 @@ typedef enum jobmode
     BUILTIN_MODE
 } JobMode;
 
+struct pool;
+struct pipeedge;
+struct placement;
+struct request;
+
 typedef struct job
 {
+    Arena *arena; // the job, its line and its processes are all allocated here
     int id;
     pid_t pgid;
     char *line;
+    char *strings; // NUL-terminated copy of line which cmd, args and filepaths of the processes point into
     JobState job_state;
     JobMode job_mode;
+    bool background; // the line ended with '&'
+    bool timed;      // the line started with `time`: report usage when the job is over
+    struct pool *pool; // the `parallel` pool this job is a task of, or NULL
+    bool no_history;   // a run of `bench` or `pipes`, not a typed line
+    int pipe_size;     // F_SETPIPE_SZ of its pipes, 0 for the default capacity
+    struct pipeedge *edges; // counters shared with the relays of a monitored pipeline, or NULL
+    size_t n_edges;
+    struct placement *placement; // CPUs, nice level and policy of its processes (`place`), or NULL
+    int priority;          // in the admission queue (`admit -P`)
+    struct job *queue_next; // next Pending job in the admission queue
+    struct request *request; // the daemon request this job answers (server.h), or NULL
     Process *process_queue; // the first one in linked list
     int running_procs;      // The total number of unfinished process. If this is reduced to 0, this job is "Done".
+    Usage usage;            // sum over the processes that have terminated
+    bool listed;            // in shell->jobs or shell->finished_jobs: counted by state in the stats page (stats.h)
+    bool counted_back;      // counted by running_back_jobs()
+    int counted_procs;      // its share of running_processes()
+    struct job *prev;
     struct job *next;
 } Job;
 
@@ -56,20 +87,44 @@ typedef struct shell
     Job *jobs;
     Job *finished_jobs;
     Job *cur_job;
+    Arena *line_arena; // tokens of the line being evaluated, reset after every line
+    bool interactive; // false in script mode: no prompt and no terminal control
+    bool serving;     // daemon mode (server.h): nothing may wait in the foreground
 } Shell;
 
 extern Shell *shell;
 
-int set_jobid();
 Job *new_job(size_t byte_size);
+// Fresh copy of a job that was parsed but never run, in an arena of its own.
+Job *copy_job(const Job *job);
+// Copy of the job of a builtin that runs the rest of its line, as a foreground job: its first n_words words
+// (the builtin and its options) dropped. *line_offset is where the rest starts in the copy's line.
+Job *copy_rest_of_line(const Job *job, size_t n_words, size_t *line_offset);
+void free_job(Job *job);
 void insert_job(Job *new_job);
 void delete_job(int job_id);
 void insert_finished_job(Job *finished_job);
+void finish_job(Job *job);
+// Change the state of a job, and the count of jobs in each state with it.
+void set_job_state(Job *job, JobState state);
 void free_jobs();
+// Background jobs that are Running, and unfinished processes of Running jobs: the admission limits (admit.h).
+int running_back_jobs();
+int running_processes();
 
 void run_job(Job *job);
+// Exit status of a pipeline that is over: that of its last process, 128+N if signal N killed it.
+int exit_status(const Job *job);
+// Run a job made by copy_rest_of_line() as a typed line would: in the background if the line ended with '&',
+// and always in daemon mode, where it answers the request of its builtin.
+void launch_job(Job *job);
+void print_notice(Job *job);
+bool update_process_status(Job *job, Process *process, int status, const struct rusage *rusage);
 void wait_fore_job(Job *job);
-void wait_back_job();
+// Reap every child whose status changed. Return the number of notices printed.
+int wait_back_job();
+// Reap a process whose pidfd became readable. Return the number of notices printed.
+int reap_process(Process *process);
 
 void run_command(Process *command);
 void jobs(char **args);
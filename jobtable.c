@@ -0,0 +1,129 @@
+#include "jobtable.h"
+#include "job.h"
+
+static JobTable job_table = {.next_id = 1};
+
+int alloc_jobid()
+{
+    if (job_table.n_free_ids > 0)
+        return job_table.free_ids[--job_table.n_free_ids];
+
+    return job_table.next_id++;
+}
+
+void register_job(Job *job)
+{
+    if ((size_t)job->id > job_table.n_slots)
+    {
+        size_t n_slots = job_table.n_slots ? job_table.n_slots * 2 : 64;
+        while (n_slots < (size_t)job->id)
+            n_slots *= 2;
+
+        job_table.slots = (Job **)realloc(job_table.slots, n_slots * sizeof(Job *));
+        job_table.free_ids = (int *)realloc(job_table.free_ids, n_slots * sizeof(int));
+        memset(job_table.slots + job_table.n_slots, 0, (n_slots - job_table.n_slots) * sizeof(Job *));
+        job_table.n_slots = n_slots;
+    }
+
+    job_table.slots[job->id - 1] = job;
+}
+
+void unregister_job(Job *job)
+{
+    if (find_job(job->id) != job)
+        return;
+
+    job_table.slots[job->id - 1] = NULL;
+    job_table.free_ids[job_table.n_free_ids++] = job->id;
+}
+
+Job *find_job(int job_id)
+{
+    if (job_id < 1 || (size_t)job_id > job_table.n_slots)
+        return NULL;
+
+    return job_table.slots[job_id - 1];
+}
+
+/* pid map */
+
+static size_t pid_slot(pid_t pid)
+{
+    return ((size_t)pid * 2654435761u) & (job_table.procs_capacity - 1); // Knuth's multiplicative hash
+}
+
+static void grow_procs()
+{
+    Process **old_procs = job_table.procs;
+    size_t old_capacity = job_table.procs_capacity;
+
+    job_table.procs_capacity = old_capacity ? old_capacity * 2 : 256;
+    job_table.procs = (Process **)calloc(job_table.procs_capacity, sizeof(Process *));
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_procs[i] == NULL)
+            continue;
+
+        size_t slot = pid_slot(old_procs[i]->pid);
+        while (job_table.procs[slot] != NULL)
+            slot = (slot + 1) & (job_table.procs_capacity - 1);
+        job_table.procs[slot] = old_procs[i];
+    }
+    free(old_procs);
+}
+
+void register_process(Process *process)
+{
+    if ((job_table.n_procs + 1) * 2 > job_table.procs_capacity)
+        grow_procs();
+
+    size_t slot = pid_slot(process->pid);
+    while (job_table.procs[slot] != NULL && job_table.procs[slot] != process)
+        slot = (slot + 1) & (job_table.procs_capacity - 1);
+
+    if (job_table.procs[slot] == NULL)
+        job_table.n_procs++;
+    job_table.procs[slot] = process;
+}
+
+void unregister_process(Process *process)
+{
+    if (job_table.procs_capacity == 0)
+        return;
+
+    size_t mask = job_table.procs_capacity - 1;
+    size_t slot = pid_slot(process->pid);
+    while (job_table.procs[slot] != process)
+    {
+        if (job_table.procs[slot] == NULL)
+            return;
+        slot = (slot + 1) & mask;
+    }
+
+    // Backward-shift deletion: pull up later entries of the probe run so that no tombstone is needed.
+    size_t hole = slot;
+    for (size_t cur = (slot + 1) & mask; job_table.procs[cur] != NULL; cur = (cur + 1) & mask)
+    {
+        size_t home = pid_slot(job_table.procs[cur]->pid);
+        if (((cur - home) & mask) >= ((cur - hole) & mask))
+        {
+            job_table.procs[hole] = job_table.procs[cur];
+            hole = cur;
+        }
+    }
+    job_table.procs[hole] = NULL;
+    job_table.n_procs--;
+}
+
+Process *find_process(pid_t pid)
+{
+    if (job_table.procs_capacity == 0)
+        return NULL;
+
+    for (size_t slot = pid_slot(pid);; slot = (slot + 1) & (job_table.procs_capacity - 1))
+    {
+        if (job_table.procs[slot] == NULL || job_table.procs[slot]->pid == pid)
+            return job_table.procs[slot];
+    }
+}
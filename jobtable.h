@@ -0,0 +1,45 @@
+#ifndef jobtable_h
+#define jobtable_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "process.h"
+
+struct job;
+
+/**
+ *
+ * Indexes over the live jobs so that bookkeeping stays O(1) with thousands of jobs:
+ *
+ * - a slot array indexed by job id, with a free list (stack) of released ids;
+ * - an open-addressing pid -> Process map (linear probing, backward-shift deletion),
+ *   the Job being reached through process->job.
+ *
+**/
+typedef struct jobtable
+{
+    struct job **slots; // slots[id - 1]
+    size_t n_slots;
+    int *free_ids;
+    size_t n_free_ids;
+    int next_id; // smallest id never handed out
+
+    Process **procs; // pid map
+    size_t procs_capacity;
+    size_t n_procs;
+} JobTable;
+
+int alloc_jobid();
+void register_job(struct job *job);
+void unregister_job(struct job *job); // also releases job->id
+struct job *find_job(int job_id);
+
+void register_process(Process *process);
+void unregister_process(Process *process);
+Process *find_process(pid_t pid);
+
+#endif
@@ -0,0 +1,721 @@
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#include "complete.h"
+#include "history.h"
+#include "lineedit.h"
+#include "parser.h"
+
+#define CONTROL(c) ((c) & 0x1f)
+#define PENDING_SIZE 4096
+#define SEARCH_SIZE 256
+
+typedef enum keystate
+{
+    KEY_NORMAL,
+    KEY_ESC, // after ESC
+    KEY_CSI, // after ESC [, reading parameters
+    KEY_SS3  // after ESC O
+} KeyState;
+
+static bool enabled = false;
+static bool editing = false; // between begin_line() and the end of the line
+static bool hidden = false;  // erased by hide_line()
+static struct termios cooked; // mode of the terminal when the shell started
+static const char *prompt = "";
+
+static char *line = NULL;
+static size_t len = 0, capacity = 0, cursor = 0;
+
+static char pending[PENDING_SIZE]; // keys typed ahead of the next line
+static size_t pending_len = 0;
+
+static KeyState key_state = KEY_NORMAL;
+static int csi_param = 0;
+static bool last_key_tab = false;
+
+static size_t history_end = 0; // history_index of the line being typed
+static size_t history_index = 0;
+static char *draft = NULL; // the line being typed, while walking the history
+static size_t draft_len = 0;
+
+static bool searching = false;
+static char search[SEARCH_SIZE];
+static size_t search_len = 0;
+static long search_match = -1;
+
+static Completions completions;
+
+static char *output = NULL;
+static size_t output_len = 0, output_capacity = 0;
+
+/* output */
+
+static void emit(const char *data, size_t size)
+{
+    if (output_len + size > output_capacity)
+    {
+        size_t grown_capacity = output_capacity ? output_capacity : EDIT_INITIAL_CAPACITY;
+        while (output_len + size > grown_capacity)
+            grown_capacity *= 2;
+        char *grown = (char *)realloc(output, grown_capacity);
+        if (grown == NULL)
+            return;
+        output = grown;
+        output_capacity = grown_capacity;
+    }
+    memcpy(output + output_len, data, size);
+    output_len += size;
+}
+
+static void emit_string(const char *string)
+{
+    emit(string, strlen(string));
+}
+
+static void flush_output()
+{
+    fflush(stdout); // whatever the shell printf()'d goes first
+    for (size_t done = 0; done < output_len;)
+    {
+        ssize_t n = write(STDOUT_FILENO, output + done, output_len - done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    output_len = 0;
+}
+
+static bool is_continuation(char c)
+{
+    return ((unsigned char)c & 0xc0) == 0x80;
+}
+
+// Terminal columns taken by size bytes of UTF-8 (one per character, as far as we care)
+static size_t columns(const char *s, size_t size)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < size; i++)
+        n += !is_continuation(s[i]);
+    return n;
+}
+
+static void refresh()
+{
+    char move[32];
+
+    emit_string("\r");
+    if (searching)
+    {
+        emit_string("(reverse-i-search)`");
+        emit(search, search_len);
+        emit_string("': ");
+        emit(line, len);
+        emit_string("\x1b[K");
+    }
+    else
+    {
+        emit_string(prompt);
+        emit(line, len);
+        emit_string("\x1b[K");
+        size_t back = columns(line + cursor, len - cursor);
+        if (back > 0)
+            emit(move, snprintf(move, sizeof(move), "\x1b[%zuD", back));
+    }
+    flush_output();
+}
+
+static void bell()
+{
+    emit_string("\a");
+    flush_output();
+}
+
+/* terminal */
+
+bool init_line_editor()
+{
+    const char *term = getenv("TERM");
+
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) || term == NULL || strcmp(term, "dumb") == 0)
+        return false;
+    if (tcgetattr(STDIN_FILENO, &cooked) == -1)
+        return false;
+
+    enabled = true;
+    return true;
+}
+
+bool line_editor_enabled()
+{
+    return enabled;
+}
+
+static void raw_mode()
+{
+    struct termios raw = cooked;
+
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw); // output post-processing stays on: "\n" is still "\r\n"
+}
+
+static void end_line()
+{
+    if (!editing)
+        return;
+    editing = false;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &cooked);
+}
+
+/* editing */
+
+static bool reserve(size_t size)
+{
+    if (len + size <= capacity)
+        return true;
+
+    size_t grown_capacity = capacity ? capacity : EDIT_INITIAL_CAPACITY;
+    while (len + size > grown_capacity)
+        grown_capacity *= 2;
+    char *grown = (char *)realloc(line, grown_capacity);
+    if (grown == NULL)
+        return false;
+    line = grown;
+    capacity = grown_capacity;
+    return true;
+}
+
+// Replace line[start, end) with size bytes of text and put the cursor after them.
+static void replace(size_t start, size_t end, const char *text, size_t size)
+{
+    if (size > end - start && !reserve(size - (end - start)))
+        return;
+    memmove(line + start + size, line + end, len - end);
+    memcpy(line + start, text, size);
+    len = len - (end - start) + size;
+    cursor = start + size;
+}
+
+static void set_line(const char *text, size_t size)
+{
+    len = 0;
+    replace(0, 0, text, size);
+}
+
+static size_t char_before(size_t pos)
+{
+    if (pos > 0)
+        pos--;
+    while (pos > 0 && is_continuation(line[pos]))
+        pos--;
+    return pos;
+}
+
+static size_t char_after(size_t pos)
+{
+    if (pos < len)
+        pos++;
+    while (pos < len && is_continuation(line[pos]))
+        pos++;
+    return pos;
+}
+
+static void kill_word()
+{
+    size_t start = cursor;
+    while (start > 0 && line[start - 1] == ' ')
+        start--;
+    while (start > 0 && line[start - 1] != ' ')
+        start--;
+    replace(start, cursor, "", 0);
+}
+
+static void walk_history(int delta)
+{
+    size_t index = history_index + delta;
+
+    if ((delta < 0 && history_index == 0) || index > history_end)
+    {
+        bell();
+        return;
+    }
+
+    if (history_index == history_end)
+    {
+        free(draft);
+        draft = (char *)malloc(len + 1);
+        if (draft != NULL)
+            memcpy(draft, line, len);
+        draft_len = draft != NULL ? len : 0;
+    }
+
+    history_index = index;
+    if (index == history_end)
+    {
+        set_line(draft, draft_len);
+    }
+    else
+    {
+        const HistoryRecord *record = history_record(index);
+        set_line(record->line, record->line_len);
+    }
+    refresh();
+}
+
+/* reverse search */
+
+static void search_history(long before)
+{
+    if (search_len == 0)
+        return;
+
+    long id = history_search_back(search, before);
+    if (id == -1)
+    {
+        bell();
+        return;
+    }
+    const HistoryRecord *record = history_record(id);
+    search_match = id;
+    set_line(record->line, record->line_len);
+}
+
+static void start_search()
+{
+    free(draft);
+    draft = (char *)malloc(len + 1);
+    if (draft != NULL)
+        memcpy(draft, line, len);
+    draft_len = draft != NULL ? len : 0;
+
+    searching = true;
+    search_len = 0;
+    search[0] = '\0';
+    search_match = history_end;
+    refresh();
+}
+
+// Return true if the key was used up by the search.
+static bool search_key(char c)
+{
+    if (c == CONTROL('R'))
+    {
+        search_history(search_match);
+    }
+    else if (c == CONTROL('G') || c == CONTROL('C'))
+    {
+        set_line(draft, draft_len);
+        searching = false;
+    }
+    else if (c == 0x7f || c == CONTROL('H'))
+    {
+        if (search_len > 0)
+            search[--search_len] = '\0';
+        search_match = history_end;
+        search_history(search_match);
+    }
+    else if ((unsigned char)c >= 0x20 && search_len + 1 < SEARCH_SIZE)
+    {
+        search[search_len++] = c;
+        search[search_len] = '\0';
+        search_history(search_match + 1); // the current match may still do
+    }
+    else
+    {
+        searching = false; // any other key takes the match and acts as usual
+        cursor = len;
+        refresh();
+        return false;
+    }
+
+    refresh();
+    return true;
+}
+
+/* completion */
+
+static bool is_word_break(char c)
+{
+    return c == ' ' || c == '|' || c == '<' || c == '>' || c == '&';
+}
+
+static int compare_items(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Name part of a candidate: after the last '/' but its own trailing one.
+static const char *display_name(const char *item)
+{
+    size_t item_len = strlen(item);
+    const char *name = item;
+    for (size_t i = 0; i + 1 < item_len; i++)
+    {
+        if (item[i] == '/')
+            name = item + i + 1;
+    }
+    return name;
+}
+
+static void list_completions()
+{
+    struct winsize ws;
+    size_t width = 0, term_width = 80;
+    size_t n = completions.count < COMPLETE_MAX_LIST ? completions.count : COMPLETE_MAX_LIST;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        term_width = ws.ws_col;
+
+    qsort(completions.items, completions.count, sizeof(char *), compare_items);
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t w = columns(display_name(completions.items[i]), strlen(display_name(completions.items[i])));
+        if (w > width)
+            width = w;
+    }
+    width += 2;
+    size_t per_row = term_width / width > 0 ? term_width / width : 1;
+
+    emit_string("\n");
+    for (size_t i = 0; i < n; i++)
+    {
+        const char *name = display_name(completions.items[i]);
+        emit_string(name);
+        if ((i + 1) % per_row == 0 || i + 1 == n)
+        {
+            emit_string("\n");
+            continue;
+        }
+        for (size_t pad = columns(name, strlen(name)); pad < width; pad++)
+            emit_string(" ");
+    }
+    if (completions.count > n)
+    {
+        char more[64];
+        emit(more, snprintf(more, sizeof(more), "... and %zu more\n", completions.count - n));
+    }
+    refresh();
+}
+
+static void complete(bool tab_again)
+{
+    size_t start = cursor;
+    while (start > 0 && !is_word_break(line[start - 1]))
+        start--;
+
+    size_t before = start;
+    while (before > 0 && line[before - 1] == ' ')
+        before--;
+    bool command = before == 0 || line[before - 1] == '|' || (before == 4 && memcmp(line, "time", 4) == 0);
+
+    const char *word = line + start;
+    size_t word_len = cursor - start;
+
+    clear_completions(&completions);
+    if (command && memchr(word, '/', word_len) == NULL)
+        complete_command(&completions, word, word_len);
+    else
+        complete_path(&completions, word, word_len);
+
+    if (completions.count == 0)
+    {
+        bell();
+        return;
+    }
+
+    if (completions.count == 1)
+    {
+        const char *item = completions.items[0];
+        size_t item_len = strlen(item);
+        replace(start, cursor, item, item_len);
+        if (item[item_len - 1] != '/')
+            replace(cursor, cursor, " ", 1);
+        refresh();
+        return;
+    }
+
+    size_t prefix_len = common_prefix(&completions);
+    if (prefix_len > word_len)
+    {
+        replace(start, cursor, completions.items[0], prefix_len);
+        refresh();
+    }
+    else if (tab_again)
+    {
+        list_completions();
+    }
+    else
+    {
+        bell();
+    }
+}
+
+/* keys */
+
+static void accept_line()
+{
+    cursor = len;
+    refresh();
+    emit_string("\n");
+    flush_output();
+    end_line();
+
+    push_input(line, len);
+    push_input("\n", 1);
+}
+
+static void cursor_key(char key)
+{
+    switch (key)
+    {
+    case 'A':
+        walk_history(-1);
+        return;
+    case 'B':
+        walk_history(1);
+        return;
+    case 'C':
+        cursor = char_after(cursor);
+        break;
+    case 'D':
+        cursor = char_before(cursor);
+        break;
+    case 'H':
+        cursor = 0;
+        break;
+    case 'F':
+        cursor = len;
+        break;
+    default:
+        return;
+    }
+    refresh();
+}
+
+static void escape_key(char c)
+{
+    switch (key_state)
+    {
+    case KEY_ESC:
+        key_state = c == '[' ? KEY_CSI : c == 'O' ? KEY_SS3 : KEY_NORMAL;
+        csi_param = 0;
+        return;
+
+    case KEY_SS3:
+        key_state = KEY_NORMAL;
+        cursor_key(c);
+        return;
+
+    default: // KEY_CSI
+        if (c >= '0' && c <= '9')
+        {
+            csi_param = csi_param * 10 + (c - '0');
+            return;
+        }
+        if (c == ';')
+            return;
+        key_state = KEY_NORMAL;
+        if (c != '~')
+        {
+            cursor_key(c);
+            return;
+        }
+
+        if (csi_param == 1 || csi_param == 7)
+            cursor_key('H');
+        else if (csi_param == 4 || csi_param == 8)
+            cursor_key('F');
+        else if (csi_param == 3 && cursor < len)
+        {
+            replace(cursor, char_after(cursor), "", 0);
+            refresh();
+        }
+        return;
+    }
+}
+
+static void handle_key(char c)
+{
+    bool tab_again = last_key_tab;
+    last_key_tab = false;
+
+    if (key_state != KEY_NORMAL)
+    {
+        escape_key(c);
+        return;
+    }
+    if (searching && search_key(c))
+        return;
+
+    switch (c)
+    {
+    case '\r':
+    case '\n':
+        accept_line();
+        return;
+
+    case '\t':
+        complete(tab_again);
+        last_key_tab = true;
+        return;
+
+    case '\x1b':
+        key_state = KEY_ESC;
+        return;
+
+    case CONTROL('A'):
+        cursor = 0;
+        break;
+    case CONTROL('E'):
+        cursor = len;
+        break;
+    case CONTROL('B'):
+        cursor = char_before(cursor);
+        break;
+    case CONTROL('F'):
+        cursor = char_after(cursor);
+        break;
+    case CONTROL('P'):
+        walk_history(-1);
+        return;
+    case CONTROL('N'):
+        walk_history(1);
+        return;
+    case CONTROL('R'):
+        start_search();
+        return;
+
+    case 0x7f:
+    case CONTROL('H'):
+        if (cursor == 0)
+            return;
+        replace(char_before(cursor), cursor, "", 0);
+        break;
+
+    case CONTROL('D'):
+        if (len == 0)
+        {
+            emit_string("\n");
+            flush_output();
+            end_line();
+            close_input();
+            return;
+        }
+        if (cursor == len)
+            return;
+        replace(cursor, char_after(cursor), "", 0);
+        break;
+
+    case CONTROL('K'):
+        len = cursor;
+        break;
+    case CONTROL('U'):
+        replace(0, cursor, "", 0);
+        break;
+    case CONTROL('W'):
+        kill_word();
+        break;
+
+    case CONTROL('L'):
+        emit_string("\x1b[H\x1b[2J");
+        break;
+
+    case CONTROL('C'):
+        emit_string("^C\n");
+        len = cursor = 0;
+        history_index = history_end;
+        break;
+
+    default:
+        if ((unsigned char)c < 0x20)
+            return; // other control keys do nothing
+        replace(cursor, cursor, &c, 1);
+        break;
+    }
+    refresh();
+}
+
+static void feed_keys(const char *keys, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!editing)
+        {
+            // typed ahead of the next prompt: keep them for begin_line()
+            size_t rest = n - i < PENDING_SIZE - pending_len ? n - i : PENDING_SIZE - pending_len;
+            memcpy(pending + pending_len, keys + i, rest);
+            pending_len += rest;
+            return;
+        }
+        handle_key(keys[i]);
+    }
+}
+
+void begin_line(const char *new_prompt)
+{
+    static bool registered = false;
+    if (!registered)
+    {
+        atexit(end_line); // do not leave the terminal raw
+        registered = true;
+    }
+
+    prompt = new_prompt;
+    len = cursor = 0;
+    key_state = KEY_NORMAL;
+    last_key_tab = false;
+    searching = false;
+    history_end = history_index = history_size();
+
+    editing = true;
+    raw_mode();
+    refresh();
+
+    if (pending_len > 0)
+    {
+        char keys[PENDING_SIZE];
+        size_t n = pending_len;
+        memcpy(keys, pending, n);
+        pending_len = 0;
+        feed_keys(keys, n);
+    }
+}
+
+ssize_t edit_input()
+{
+    char keys[256];
+    ssize_t n;
+
+    while ((n = read(STDIN_FILENO, keys, sizeof(keys))) == -1 && errno == EINTR)
+        ;
+    if (n <= 0)
+    {
+        end_line();
+        close_input();
+        return n;
+    }
+
+    feed_keys(keys, n);
+    return n;
+}
+
+void hide_line()
+{
+    if (!editing || hidden)
+        return;
+    emit_string("\r\x1b[K");
+    flush_output();
+    hidden = true;
+}
+
+void show_line()
+{
+    if (editing && hidden)
+        refresh();
+    hidden = false;
+}
@@ -0,0 +1,44 @@
+#ifndef lineedit_h
+#define lineedit_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define EDIT_INITIAL_CAPACITY 256
+#define COMPLETE_MAX_LIST 256 // candidates listed on a second Tab; the rest are counted
+
+/**
+ *
+ * Line editor of the interactive shell, in front of read_command_line().
+ *
+ * The terminal is in raw mode only while a line is being edited; it is back in
+ * the mode the shell started with before the line runs, so jobs (and builtins
+ * reading stdin) see the usual cooked terminal. Keys are read as the event loop
+ * finds stdin readable, so background jobs are still reaped and noticed while
+ * typing. A finished line is handed to stdin's line buffer with a trailing
+ * newline, and tokenized from there as if it had been read.
+ *
+ * Keys: ^A/^E Home/End, ^B/^F and the arrows move, ^H/Backspace and ^D/Delete
+ * delete, ^K ^U ^W kill, ^L clears the screen, ^C drops the line, ^D on an empty
+ * line is EOF, Up/Down (^P/^N) walk the history, ^R searches it, Tab completes
+ * commands in command position and paths elsewhere (twice lists the candidates).
+ *
+**/
+
+// Enable the editor if stdin and stdout are a terminal that is not "dumb".
+bool init_line_editor();
+bool line_editor_enabled();
+// Print the prompt and start editing a new line, in raw mode.
+void begin_line(const char *prompt);
+// Read the keys available on stdin and apply them to the line. Return what read() returned.
+ssize_t edit_input();
+// Erase the line from the screen before printing something else, e.g. job notices.
+void hide_line();
+// Print the prompt and the line again after hide_line().
+void show_line();
+
+#endif
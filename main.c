@@ -1,77 +1,61 @@
 #include "job.h"
 #include "parser.h"
 #include "process.h"
+#include "server.h"
+#include "forkserver.h"
+#include "shell.h"
+#include "stats.h"
+#include "trace.h"
 #include "util.h"
 
 Shell *shell;
 
-int main()
+int main(int argc, char **argv)
 {
+    fork_server_main(argc, argv); // does not return in the fork server
+
     // setvbuf(stdout, NULL, _IONBF, 0); //test
 
     shell = (Shell *)calloc(1, sizeof(Shell));
 
-    set_ignore();
-
-    while (1)
-    {
-        size_t line_size = 0;
-        Token *tokens = (Token *)calloc(1, sizeof(Token));
+    shell->line_arena = new_arena(ARENA_CHUNK_SIZE);
 
-        printf("shellman$ ");
-        line_size = tokenize_line(tokens);
+    init_trace();
+    init_stats();
 
-        wait_back_job();
+    set_ignore();
 
-        shell->cur_job = new_job(line_size);
-        if (parse(shell->cur_job, tokens) == -1)
-        {
-            printf("-shellman: failed to parse tokens\n");
-            goto POSTPROCESSING;
-        }
+    if (argc >= 2)
+    {
+        long n_commands;
 
-        if (shell->cur_job->job_mode != BUILTIN_MODE && shell->cur_job != NULL)
+        if (strcmp(argv[1], "-d") == 0)
         {
-            insert_job(shell->cur_job);
+            if (argc < 3)
+            {
+                printf("-shellman: -d: option requires a socket path\n");
+                exit(EXIT_FAILURE);
+            }
+            exit(run_server(argv[2]) == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
-        run_job(shell->cur_job);
-
-        switch (shell->cur_job->job_mode)
+        else if (strcmp(argv[1], "-c") == 0)
         {
-        case BACK_MODE:
-            goto BACKGROUND;
-            break;
-
-        case FORE_MODE:
-            goto FOREGROUND;
-            break;
-
-        default:
-            goto POSTPROCESSING;
+            if (argc < 3)
+            {
+                printf("-shellman: -c: option requires an argument\n");
+                exit(EXIT_FAILURE);
+            }
+            n_commands = run_script(argv[2], strlen(argv[2]));
         }
-
-    FOREGROUND:
-        // To prevent SIGTTIN, tcsetpgrp() for setting current job's pgrp to foreground process is called in run_job()
-        shell->cur_job->job_state = Running;
-
-        wait_fore_job(shell->cur_job);
-
-        if (tcsetpgrp(STDIN_FILENO, getpgid((pid_t)0)) == -1)
+        else
         {
-            perror("tcsetpgrp");
+            n_commands = run_script_file(argv[1]);
         }
-        goto POSTPROCESSING;
 
-    BACKGROUND:
-        shell->cur_job->job_state = Running;
-        printf("[%d] %d %s\n", shell->cur_job->id, shell->cur_job->pgid, shell->cur_job->line);
-        goto POSTPROCESSING;
-
-    POSTPROCESSING:
-        free_token(tokens);
-        free_jobs(); // free jobs and finished_job_list
-        printf("\n");
+        exit(n_commands == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
     }
 
+    run_interactive();
+
     exit(EXIT_SUCCESS);
 }
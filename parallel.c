@@ -0,0 +1,400 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "parallel.h"
+#include "job.h"
+
+extern char **environ;
+
+static bool task_failed(Job *job)
+{
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+    {
+        if (cur_proc->pid == 0) // could not be launched
+            return true;
+        if (WIFSIGNALED(cur_proc->status) || (WIFEXITED(cur_proc->status) && WEXITSTATUS(cur_proc->status) != 0))
+            return true;
+    }
+    return false;
+}
+
+static size_t substituted_size(const char *arg, size_t item_len)
+{
+    size_t size = 0;
+    for (const char *c = arg; *c != '\0'; c++)
+    {
+        if (c[0] == '{' && c[1] == '}')
+        {
+            size += item_len;
+            c++;
+        }
+        else
+        {
+            size++;
+        }
+    }
+    return size;
+}
+
+// Copy arg to dest with every "{}" replaced by the item. Return the end of the copy.
+static char *substitute(char *dest, const char *arg, const char *item, size_t item_len)
+{
+    for (const char *c = arg; *c != '\0'; c++)
+    {
+        if (c[0] == '{' && c[1] == '}')
+        {
+            memcpy(dest, item, item_len);
+            dest += item_len;
+            c++;
+        }
+        else
+        {
+            *dest++ = *c;
+        }
+    }
+    return dest;
+}
+
+static bool has_placeholder(char **template)
+{
+    for (size_t i = 0; template[i] != NULL; i++)
+    {
+        if (strstr(template[i], "{}") != NULL)
+            return true;
+    }
+    return false;
+}
+
+// Room for the line of jobs: the template and the first items of a batch, then "...".
+#define MAX_DISPLAY_SIZE 256
+
+static void add_task_arg(Job *job, char *arg, char **line, bool *truncated)
+{
+    Process *process = job->process_queue;
+
+    if (process->cmd == NULL)
+        process->cmd = arg;
+    push_arg(job->arena, process, arg);
+
+    if (*truncated)
+        return;
+    if (process->n_args > 1 && (size_t)(*line - job->line) + strlen(arg) > MAX_DISPLAY_SIZE)
+    {
+        *line = stpcpy(*line, "... ");
+        *truncated = true;
+        return;
+    }
+    *line = stpcpy(*line, arg);
+    *(*line)++ = ' ';
+}
+
+// Start a task running the template on the items of the batch, and empty the batch.
+static void launch_task(Pool *pool)
+{
+    const char *item = pool->batch;
+    size_t item_len = strlen(item);
+    bool substitute_item = pool->substitute && pool->batch_items == 1 && has_placeholder(pool->template);
+    size_t byte_size = pool->batch_used + 1;
+    size_t i;
+
+    for (i = 0; pool->template[i] != NULL; i++)
+        byte_size += (substitute_item ? substituted_size(pool->template[i], item_len) : strlen(pool->template[i])) + 1;
+
+    Job *job = new_job(byte_size + MAX_DISPLAY_SIZE);
+    if (job == NULL)
+    {
+        perror("-shellman: new_job");
+        pool->input_done = true;
+        pool->batch_used = pool->batch_items = pool->batch_bytes = 0;
+        return;
+    }
+
+    char *string = job->strings, *line = job->line;
+    bool truncated = false;
+
+    job->job_mode = BACK_MODE;
+    job->background = true;
+    job->pool = pool;
+
+    for (i = 0; pool->template[i] != NULL; i++)
+    {
+        char *arg = string;
+        string = substitute_item ? substitute(string, pool->template[i], item, item_len) : stpcpy(string, pool->template[i]);
+        *string++ = '\0';
+        add_task_arg(job, arg, &line, &truncated);
+    }
+
+    for (i = 0; !substitute_item && i < pool->batch_items; i++)
+    {
+        char *arg = string;
+        string = stpcpy(string, item) + 1;
+        item += string - arg;
+        add_task_arg(job, arg, &line, &truncated);
+    }
+    line[-1] = '\0';
+
+    pool->batch_used = pool->batch_items = pool->batch_bytes = 0;
+
+    job->process_queue->read_filepath = "/dev/null"; // a task in the background must not read the terminal
+
+    pool->running_tasks++;
+    pool->started++;
+
+    insert_job(job);
+    run_job(job);
+    if (job->running_procs == 0)
+        finish_job(job); // nothing could be launched
+    else
+        set_job_state(job, Running);
+}
+
+static void free_pool(Pool *pool)
+{
+    for (size_t i = 0; pool->template[i] != NULL; i++)
+        free(pool->template[i]);
+    free(pool->template);
+    free(pool->batch);
+    free(pool->input.data);
+    if (pool->input_fd != -1)
+        close(pool->input_fd);
+    free(pool);
+}
+
+static void finish_pool(Pool *pool)
+{
+    struct timespec finish;
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    double elapsed = (finish.tv_sec - pool->start.tv_sec) + (finish.tv_nsec - pool->start.tv_nsec) / 1e9;
+
+    printf("%s: %d tasks", pool->name, pool->started);
+    if (pool->max_items != 1)
+        printf(" (%zu items)", pool->n_items);
+    printf(", %d failed in %.3f s (%.1f tasks/s)\n", pool->failed, elapsed,
+           elapsed > 0 ? pool->started / elapsed : 0.0);
+
+    pool->finished = true;
+    if (pool->background)
+        free_pool(pool);
+}
+
+// What an item adds to the argv and envp the kernel copies at exec: the string, its NUL and the pointer.
+static size_t arg_cost(size_t len)
+{
+    return len + 1 + sizeof(char *);
+}
+
+static bool batch_fits(Pool *pool, size_t item_len)
+{
+    return pool->batch_items < pool->max_items && pool->batch_bytes + arg_cost(item_len) <= pool->max_bytes;
+}
+
+static void append_to_batch(Pool *pool, const char *item, size_t item_len)
+{
+    if (pool->batch_used + item_len + 1 > pool->batch_capacity)
+    {
+        size_t capacity = pool->batch_capacity ? pool->batch_capacity * 2 : MAX_BUFFER_SIZE;
+        while (capacity < pool->batch_used + item_len + 1)
+            capacity *= 2;
+        char *batch = (char *)realloc(pool->batch, capacity);
+        if (batch == NULL)
+        {
+            perror("-shellman: realloc");
+            pool->input_done = true;
+            return;
+        }
+        pool->batch = batch;
+        pool->batch_capacity = capacity;
+    }
+
+    memcpy(pool->batch + pool->batch_used, item, item_len);
+    pool->batch[pool->batch_used + item_len] = '\0';
+    pool->batch_used += item_len + 1;
+    pool->batch_bytes += arg_cost(item_len);
+    pool->batch_items++;
+    pool->n_items++;
+}
+
+// Start tasks until max_tasks are running or the input is exhausted.
+static void fill_pool(Pool *pool)
+{
+    const char *item;
+    ssize_t item_len;
+
+    if (pool->filling || pool->finished)
+        return;
+
+    pool->filling = true;
+    while (pool->running_tasks < pool->max_tasks)
+    {
+        if (pool->input_done)
+        {
+            if (pool->batch_items > 0)
+                launch_task(pool); // the last, partial batch
+            break;
+        }
+
+        if (pool->input_fd == -1)
+            item_len = read_stdin_line(&item);
+        else
+            item_len = read_line(&pool->input, pool->input_fd, &item);
+
+        if (item_len == -1)
+        {
+            pool->input_done = true;
+            continue;
+        }
+        if (item_len == 0)
+            continue;
+
+        if (pool->batch_items > 0 && !batch_fits(pool, item_len))
+            launch_task(pool); // the item goes into the next batch, which may have to wait for a free slot
+        append_to_batch(pool, item, item_len);
+        if (pool->batch_items == pool->max_items)
+            launch_task(pool);
+    }
+    pool->filling = false;
+
+    if (pool->input_done && pool->batch_items == 0 && pool->running_tasks == 0)
+        finish_pool(pool);
+}
+
+void pool_task_done(Job *job)
+{
+    Pool *pool = job->pool;
+
+    pool->running_tasks--;
+    if (task_failed(job))
+        pool->failed++;
+
+    fill_pool(pool);
+}
+
+// The argv and envp budget of one exec: ARG_MAX less the environment, the template and some headroom.
+static size_t exec_budget(char **template)
+{
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t used = 2048 + PATH_MAX; // headroom POSIX asks for, and the path the kernel copies as well
+
+    for (char **env = environ; *env != NULL; env++)
+        used += arg_cost(strlen(*env));
+    for (size_t i = 0; template[i] != NULL; i++)
+        used += arg_cost(strlen(template[i]));
+
+    return arg_max > 0 && (size_t)arg_max > used ? (size_t)arg_max - used : 0;
+}
+
+// Take the options of parallel or xargs from args, build the pool and run it to the end (or start it in the background).
+static void run_pool(Process *command, const char *name, const char *options, const char *usage)
+{
+    char **args = command->args + 1;
+    char *input_filepath = command->read_filepath;
+    bool background = command->job != NULL && (command->job->background || shell->serving);
+    long max_tasks = 0, max_items = 0;
+    size_t i, n_template;
+
+    for (i = 0; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0' && args[i][2] == '\0' &&
+                strchr(options, args[i][1]) != NULL && args[i + 1] != NULL;
+         i += 2)
+    {
+        switch (args[i][1])
+        {
+        case 'j':
+        case 'P':
+            max_tasks = atol(args[i + 1]);
+            break;
+        case 'n':
+            max_items = atol(args[i + 1]);
+            break;
+        case 'a':
+            input_filepath = args[i + 1];
+            break;
+        }
+    }
+
+    for (n_template = 0; args[i + n_template] != NULL; n_template++)
+        ;
+    if ((n_template == 0 && strcmp(name, "parallel") == 0) || max_tasks < 0 || max_items < 0)
+    {
+        printf("-shellman: %s example usage: `%s`\n", name, usage);
+        return;
+    }
+
+    Pool *pool = (Pool *)calloc(1, sizeof(Pool));
+    pool->name = name;
+    pool->template = (char **)calloc(n_template + 2, sizeof(char *));
+    for (size_t j = 0; j < n_template; j++)
+        pool->template[j] = strdup(args[i + j]);
+    if (n_template == 0)
+        pool->template[0] = strdup("echo"); // like xargs(1)
+
+    if (strcmp(name, "parallel") == 0)
+    {
+        pool->substitute = true;
+        pool->max_items = 1;
+        pool->max_bytes = SIZE_MAX;
+    }
+    else
+    {
+        pool->max_items = max_items > 0 ? (size_t)max_items : SIZE_MAX;
+        pool->max_bytes = exec_budget(pool->template);
+    }
+
+    pool->input_fd = -1;
+    if (input_filepath != NULL && (pool->input_fd = open(input_filepath, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        printf("-shellman: %s: %s: %s\n", name, input_filepath, strerror(errno));
+        free_pool(pool);
+        return;
+    }
+    if (pool->input_fd == -1 && background)
+    {
+        printf("-shellman: %s: a background pool needs `-a FILE` or `< FILE`\n", name);
+        free_pool(pool);
+        return;
+    }
+
+    if (max_tasks > 0)
+        pool->max_tasks = (int)max_tasks;
+    else
+        pool->max_tasks = pool->substitute ? (int)sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    pool->background = background;
+    clock_gettime(CLOCK_MONOTONIC, &pool->start);
+
+    fill_pool(pool); // a background pool is driven by finish_job() from here on, and frees itself
+    if (background)
+        return;
+
+    while (!pool->finished)
+    {
+        int status;
+        struct rusage rusage;
+        pid_t wpid = wait4(-1, &status, WUNTRACED, &rusage);
+        if (wpid == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("-shellman: wait4");
+            break;
+        }
+
+        Process *wait_proc = find_process(wpid);
+        if (wait_proc != NULL && update_process_status(wait_proc->job, wait_proc, status, &rusage))
+            print_notice(wait_proc->job);
+
+        free_jobs(); // finished tasks; the job of this builtin is only queued after run_job() returns
+    }
+    free_pool(pool);
+}
+
+/* builtin commands */
+
+void parallel(Process *command)
+{
+    run_pool(command, "parallel", "ja", "parallel -j 4 gzip {} < files.txt");
+}
+
+void xargs(Process *command)
+{
+    run_pool(command, "xargs", "Pna", "xargs -P 4 -n 1000 rm -f < files.txt");
+}
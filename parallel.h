@@ -0,0 +1,69 @@
+#ifndef parallel_h
+#define parallel_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "process.h"
+
+/**
+ *
+ * Pools of background tasks fed from a line source, for two builtins:
+ *
+ * `parallel [-j N] [-a FILE] CMD [ARG ...]`
+ *     Runs CMD once per line, replacing every "{}" in CMD and ARGs with the line
+ *     (or appending the line when there is no "{}"). N defaults to the online CPUs.
+ *
+ * `xargs [-P N] [-n MAX] [-a FILE] [CMD [ARG ...]]`
+ *     Runs CMD (default: echo) with as many lines appended as arguments as fit in
+ *     one exec: under sysconf(_SC_ARG_MAX) less the environment, and at most MAX
+ *     items. Up to N batches (default 1) run at once. One line is one argument, as
+ *     with `xargs -d '\n'`, so names with spaces survive.
+ *
+ * The lines come from FILE, from the redirect (`< FILE`) or from stdin. Exactly N
+ * tasks are kept running; each task is an ordinary background Job started by
+ * run_job(), so it shows up in `jobs`, and a new one is started from finish_job()
+ * as soon as one ends.
+ *
+ * In the foreground the builtin waits for the last task; with '&' it returns at once
+ * and the event loop keeps the pool going. A summary is printed when all tasks ended.
+ *
+**/
+typedef struct pool
+{
+    const char *name; // "parallel" or "xargs"
+    char **template;  // CMD and ARGs, NULL-terminated
+    bool substitute;  // replace "{}" in the template with the item (parallel)
+    size_t max_items; // items per task
+    size_t max_bytes; // arg_cost() of the items of a task
+    char *batch;      // NUL-separated items of the next task
+    size_t batch_used;
+    size_t batch_capacity;
+    size_t batch_items;
+    size_t batch_bytes;
+    size_t n_items; // read so far
+    int max_tasks;
+    int running_tasks;
+    int started;
+    int failed;
+    int input_fd; // -1: the shell's stdin buffer
+    LineBuffer input;
+    bool input_done;
+    bool filling; // fill_pool() is on the stack: finish_job() must not re-enter it
+    bool finished;
+    bool background;
+    struct timespec start;
+} Pool;
+
+// Called by finish_job() for a job whose pool is set.
+void pool_task_done(struct job *job);
+
+void parallel(Process *command);
+void xargs(Process *command);
+
+#endif
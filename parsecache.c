@@ -0,0 +1,165 @@
+#include "parsecache.h"
+
+#define HASH_PRIME 0x9e3779b97f4a7c15ULL
+
+static ParseCache parse_cache;
+
+static uint64_t rotate_left(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t mix_word(uint64_t hash, const char *bytes)
+{
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return rotate_left(hash ^ word, 31) * HASH_PRIME;
+}
+
+// Four independent lanes over 32-byte blocks, so that their multiplies overlap: a
+// byte-at-a-time hash costs more than tokenizing a long line with SIMD.
+static uint64_t hash_line(const char *line, size_t line_len)
+{
+    uint64_t lanes[4] = {HASH_PRIME, HASH_PRIME * 3, HASH_PRIME * 5, HASH_PRIME * 7};
+    size_t i = 0;
+
+    for (; i + 32 <= line_len; i += 32)
+    {
+        for (int lane = 0; lane < 4; lane++)
+            lanes[lane] = mix_word(lanes[lane], line + i + lane * 8);
+    }
+
+    uint64_t hash = line_len * HASH_PRIME;
+    for (int lane = 0; lane < 4; lane++)
+        hash = rotate_left(hash ^ lanes[lane], 27) * HASH_PRIME;
+    for (; i + 8 <= line_len; i += 8)
+        hash = mix_word(hash, line + i);
+    for (; i < line_len; i++)
+        hash = (hash ^ (unsigned char)line[i]) * HASH_PRIME;
+
+    hash ^= hash >> 33; // let the high bits reach the bucket index
+    hash *= 0xff51afd7ed558ccdULL;
+    return hash ^ (hash >> 33);
+}
+
+static ParseCacheEntry **bucket_of(uint64_t hash)
+{
+    return &parse_cache.buckets[hash & (PARSE_CACHE_BUCKETS - 1)];
+}
+
+static void unlink_lru(ParseCacheEntry *entry)
+{
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        parse_cache.lru_first = entry->lru_next;
+
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        parse_cache.lru_last = entry->lru_prev;
+}
+
+static void push_lru(ParseCacheEntry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = parse_cache.lru_first;
+    if (parse_cache.lru_first != NULL)
+        parse_cache.lru_first->lru_prev = entry;
+    else
+        parse_cache.lru_last = entry;
+    parse_cache.lru_first = entry;
+}
+
+static void remove_entry(ParseCacheEntry *entry)
+{
+    ParseCacheEntry **link = bucket_of(entry->hash);
+    while (*link != entry)
+        link = &(*link)->hash_next;
+    *link = entry->hash_next;
+
+    unlink_lru(entry);
+    free_job(entry->job);
+    free(entry);
+    parse_cache.count--;
+}
+
+Job *cached_job(const char *line, size_t line_len)
+{
+    uint64_t hash = hash_line(line, line_len);
+
+    for (ParseCacheEntry *entry = *bucket_of(hash); entry != NULL; entry = entry->hash_next)
+    {
+        if (entry->hash == hash && entry->line_len == line_len && memcmp(entry->line, line, line_len) == 0)
+        {
+            parse_cache.hits++;
+            if (entry != parse_cache.lru_first)
+            {
+                unlink_lru(entry);
+                push_lru(entry);
+            }
+            return copy_job(entry->job);
+        }
+    }
+
+    parse_cache.misses++;
+    return NULL;
+}
+
+void cache_job(const char *line, size_t line_len, const Job *job)
+{
+    ParseCacheEntry *entry = (ParseCacheEntry *)malloc(sizeof(ParseCacheEntry) + line_len);
+    if (entry == NULL)
+        return;
+    if ((entry->job = copy_job(job)) == NULL)
+    {
+        free(entry);
+        return;
+    }
+
+    if (parse_cache.count == PARSE_CACHE_ENTRIES)
+    {
+        remove_entry(parse_cache.lru_last);
+        parse_cache.evictions++;
+    }
+
+    entry->hash = hash_line(line, line_len);
+    entry->line_len = line_len;
+    memcpy(entry->line, line, line_len);
+
+    ParseCacheEntry **bucket = bucket_of(entry->hash);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    push_lru(entry);
+    parse_cache.count++;
+}
+
+void flush_parse_cache()
+{
+    while (parse_cache.lru_first != NULL)
+        remove_entry(parse_cache.lru_first);
+}
+
+/* builtin command */
+
+void parsecache(char **args)
+{
+    if (args[0] != NULL && strcmp(args[0], "-r") == 0)
+    {
+        flush_parse_cache();
+        parse_cache.hits = parse_cache.misses = parse_cache.evictions = 0;
+        return;
+    }
+    if (args[0] != NULL)
+    {
+        printf("-shellman: parsecache example usage: `parsecache` or `parsecache -r`\n");
+        return;
+    }
+
+    size_t lookups = parse_cache.hits + parse_cache.misses;
+    printf("entries\t%zu/%d\n", parse_cache.count, PARSE_CACHE_ENTRIES);
+    printf("hits\t%zu\n", parse_cache.hits);
+    printf("misses\t%zu\n", parse_cache.misses);
+    printf("evictions\t%zu\n", parse_cache.evictions);
+    printf("hit rate\t%.1f%%\n", lookups > 0 ? 100.0 * parse_cache.hits / lookups : 0.0);
+}
@@ -0,0 +1,62 @@
+#ifndef parsecache_h
+#define parsecache_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+
+#define PARSE_CACHE_ENTRIES 256 // the least recently used line is evicted past this
+#define PARSE_CACHE_BUCKETS 512 // always a power of 2
+
+/**
+ *
+ * Raw command line -> parsed job, for scripts that run the same few lines over
+ * and over.
+ *
+ * Parsing depends on nothing but the bytes of the line (commands are looked up
+ * in $PATH only when launched), so the job parse() built from a line can be kept,
+ * never run, as a template. A line seen before skips tokenize() and parse()
+ * altogether: copy_job() gives a fresh job from one allocation and a memcpy() of
+ * the strings, with argv and file paths pointed at the copy.
+ *
+ * Entries are chained in a hash table on a 64-bit hash of the line and linked
+ * in LRU order; a hit moves the entry to the front, and the entry at the back is
+ * evicted when the cache is full. Lines that do not parse are not cached.
+ *
+**/
+typedef struct parsecacheentry
+{
+    uint64_t hash;
+    Job *job; // parsed from line, never run
+    struct parsecacheentry *hash_next;
+    struct parsecacheentry *lru_prev; // more recently used
+    struct parsecacheentry *lru_next; // less recently used
+    size_t line_len;
+    char line[]; // not NUL-terminated
+} ParseCacheEntry;
+
+typedef struct parsecache
+{
+    ParseCacheEntry *buckets[PARSE_CACHE_BUCKETS];
+    ParseCacheEntry *lru_first; // most recently used
+    ParseCacheEntry *lru_last;  // evicted next
+    size_t count;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+} ParseCache;
+
+// A new job copied from the template of line, or NULL on a miss.
+Job *cached_job(const char *line, size_t line_len);
+// Keep a copy of job, just parsed from line and not run yet, as the template of line.
+void cache_job(const char *line, size_t line_len, const Job *job);
+void flush_parse_cache();
+
+void parsecache(char **args);
+
+#endif
@@ -1,39 +1,159 @@
 #include "parser.h"
 
-Token *new_token(Token *cur_token)
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static LineBuffer stdin_buffer;
+
+// space, '|', '<', '>', '&' and newline end a word
+static const bool delimiter_table[256] = {
+    [' '] = true, ['|'] = true, ['<'] = true, ['>'] = true, ['&'] = true, ['\n'] = true};
+
+static const char *scan_delimiter_scalar(const char *cur, const char *end)
+{
+    while (cur < end && !delimiter_table[(unsigned char)*cur])
+        cur++;
+
+    return cur;
+}
+
+#ifdef __SSE2__
+static const char *scan_delimiter_sse2(const char *cur, const char *end)
+{
+    const __m128i space = _mm_set1_epi8(' '), pipe = _mm_set1_epi8('|'), left = _mm_set1_epi8('<');
+    const __m128i right = _mm_set1_epi8('>'), amp = _mm_set1_epi8('&'), newline = _mm_set1_epi8('\n');
+
+    for (; end - cur >= 16; cur += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)cur);
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, pipe)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(chunk, left), _mm_cmpeq_epi8(chunk, right)));
+        hit = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, newline)));
+
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+            return cur + __builtin_ctz(mask);
+    }
+
+    return scan_delimiter_scalar(cur, end);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static const char *scan_delimiter_avx2(const char *cur, const char *end)
+{
+    const __m256i space = _mm256_set1_epi8(' '), pipe = _mm256_set1_epi8('|'), left = _mm256_set1_epi8('<');
+    const __m256i right = _mm256_set1_epi8('>'), amp = _mm256_set1_epi8('&'), newline = _mm256_set1_epi8('\n');
+
+    for (; end - cur >= 32; cur += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)cur);
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, pipe)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(chunk, left), _mm256_cmpeq_epi8(chunk, right)));
+        hit = _mm256_or_si256(hit, _mm256_or_si256(_mm256_cmpeq_epi8(chunk, amp), _mm256_cmpeq_epi8(chunk, newline)));
+
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0)
+            return cur + __builtin_ctz(mask);
+    }
+
+    return scan_delimiter_scalar(cur, end);
+}
+#endif
+
+static const char *(*scan_delimiter)(const char *cur, const char *end) = NULL;
+static const char *scan_backend = NULL;
+
+bool set_tokenizer_backend(const char *name)
 {
-    Token *new_token = (Token *)calloc(1, sizeof(Token));
-    if (new_token == NULL)
-        return NULL;
+#if defined(__x86_64__) || defined(__i386__)
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        scan_delimiter = scan_delimiter_avx2;
+        scan_backend = "avx2";
+        return true;
+    }
+#endif
+#ifdef __SSE2__
+    if (strcmp(name, "sse2") == 0)
+    {
+        scan_delimiter = scan_delimiter_sse2;
+        scan_backend = "sse2";
+        return true;
+    }
+#endif
+    if (strcmp(name, "scalar") == 0)
+    {
+        scan_delimiter = scan_delimiter_scalar;
+        scan_backend = "scalar";
+        return true;
+    }
+
+    return false;
+}
+
+const char *tokenizer_backend()
+{
+    if (scan_delimiter == NULL && !set_tokenizer_backend("avx2") && !set_tokenizer_backend("sse2"))
+        set_tokenizer_backend("scalar");
+
+    return scan_backend;
+}
+
+Token *new_token(Arena *arena, Token *cur_token)
+{
+    Token *new_token = (Token *)arena_alloc(arena, sizeof(Token));
+    if (new_token == NULL || cur_token == NULL)
+        return new_token;
 
     cur_token->next = new_token;
     new_token->prev = cur_token;
     return new_token;
 }
 
-size_t tokenize(Token *token, char *buffer)
+static bool token_equals(const char *string, size_t size, char c)
+{
+    return size == 1 && string[0] == c;
+}
+
+void tokenize(Token *token, const char *string, size_t size)
 {
-    if (token->prev == NULL || token->prev->label == PIPE)
+    token->string = string;
+    token->size = size;
+
+    if (token->prev == NULL && size == 4 && memcmp(string, "time", 4) == 0)
     {
-        token->arg_order = 0;
-        if (is_builtin(buffer) == true)
+        token->label = TIME;
+    }
+    else if (token->prev == NULL || token->prev->label == PIPE || token->prev->label == TIME)
+    {
+        if (is_builtin(string, size) == true)
             token->label = BUILTIN_CMD;
         else
             token->label = CMD;
     }
-    else if (strcmp(buffer, "|") == 0)
+    else if (token_equals(string, size, '|'))
     {
         token->label = PIPE;
     }
-    else if (strcmp(buffer, ">") == 0)
+    else if (token_equals(string, size, '>'))
     {
         token->label = RIGHT_REDIRECT;
     }
-    else if (strcmp(buffer, "<") == 0)
+    else if (token_equals(string, size, '<'))
     {
         token->label = LEFT_REDIRECT;
     }
-    else if (strcmp(buffer, "&") == 0)
+    else if (size == 2 && memcmp(string, "<<", 2) == 0)
+    {
+        token->label = HERE_DOC;
+    }
+    else if (size == 3 && memcmp(string, "<<<", 3) == 0)
+    {
+        token->label = HERE_STRING;
+    }
+    else if (token_equals(string, size, '&'))
     {
         token->label = BACKGROUND;
     }
@@ -41,97 +161,205 @@ size_t tokenize(Token *token, char *buffer)
     {
         token->label = FILE_PATH;
     }
+    else if (token->prev->label == HERE_DOC || token->prev->label == HERE_STRING)
+    {
+        token->label = HERE_WORD;
+    }
     else
     {
-        token->arg_order = token->prev->arg_order + 1;
         token->label = ARG;
     }
-
-    size_t token_size = (strlen(buffer) + 1) * sizeof(char);
-    token->string = (char *)malloc(token_size);
-
-    strcpy(token->string, buffer);
-    token->size = token_size;
-
-    return token_size + 1;
 }
 
-size_t tokenize_line(Token *token)
+size_t tokenize_string(Arena *arena, Token *token, const char *line, size_t line_len)
 {
-    int c;
-    char buffer[MAX_BUFFER_SIZE];
-    memset(buffer, '\0', sizeof(buffer));
-    size_t line_size = 0;
+    const char *cur = line, *end = line + line_len;
+    const char *line_start = NULL, *line_end = NULL;
 
-    while ((c = getchar()) != EOF)
+    tokenizer_backend(); // select the delimiter scanner on first use
+
+    while (token != NULL)
     {
-        if (token == NULL)
+        while (cur < end && *cur == ' ')
+            cur++;
+
+        if (cur == end || *cur == '\n')
             break;
 
-        if (c == ' ')
+        const char *token_end = delimiter_table[(unsigned char)*cur] ? cur + 1 : scan_delimiter(cur, end);
+        if (*cur == '<') // "<<" and "<<<" are one token
         {
-            if (strlen(buffer) > 0)
-            {
-                line_size += tokenize(token, buffer);
-                token = new_token(token);
-                memset(buffer, '\0', sizeof(buffer));
-            }
-            else
-            {
-                continue;
-            }
+            while (token_end < end && token_end - cur < 3 && *token_end == '<')
+                token_end++;
         }
-        else if (c == '\n')
-        {
-            if (strlen(buffer) > 0)
-            {
-                line_size += tokenize(token, buffer);
-                token = new_token(token);
-                memset(buffer, '\0', sizeof(buffer));
-            }
 
-            token->label = NONE;
-            break;
-        }
-        else
-        {
-            if (strlen(buffer) >= MAX_BUFFER_SIZE)
-            {
-                printf("-shellman: command too long\n");
-                return 0;
-            }
+        tokenize(token, cur, token_end - cur);
+        token = new_token(arena, token);
+
+        if (line_start == NULL)
+            line_start = cur;
+        line_end = token_end;
+        cur = token_end;
+    }
+
+    if (token != NULL)
+        token->label = NONE;
+
+    if (line_start == NULL)
+        return 0;
+
+    return (line_end - line_start) + 1;
+}
+
+// Move the unread bytes to the front and grow buf until size more bytes fit after them.
+static bool make_room(LineBuffer *buf, size_t size)
+{
+    if (buf->start > 0)
+    {
+        memmove(buf->data, buf->data + buf->start, buf->end - buf->start);
+        buf->end -= buf->start;
+        buf->start = 0;
+    }
 
-            buffer[strlen(buffer)] = c;
+    if (buf->end + size > buf->capacity)
+    {
+        size_t capacity = buf->capacity ? buf->capacity * 2 : MAX_BUFFER_SIZE;
+        while (buf->end + size > capacity)
+            capacity *= 2;
+        char *data = (char *)realloc(buf->data, capacity);
+        if (data == NULL)
+        {
+            perror("-shellman: realloc");
+            return false;
         }
+        buf->data = data;
+        buf->capacity = capacity;
     }
+    return true;
+}
+
+// Read once from fd, after making room in buf if it is full.
+static ssize_t fill_buffer(LineBuffer *buf, int fd)
+{
+    if (!make_room(buf, 1))
+        return -1;
+
+    ssize_t n;
+    while ((n = read(fd, buf->data + buf->end, buf->capacity - buf->end)) == -1 && errno == EINTR)
+        ;
+
+    if (n > 0)
+        buf->end += n;
+    return n;
+}
+
+ssize_t read_line(LineBuffer *buf, int fd, const char **line)
+{
+    size_t scanned = 0; // bytes after buf->start already known to hold no newline
 
-    if (c == EOF)
+    while (1)
     {
-        printf("-shellman: scanning EOF terminates shellman.\n");
-        exit(EXIT_SUCCESS);
+        char *newline = NULL;
+        if (buf->data != NULL)
+            newline = memchr(buf->data + buf->start + scanned, '\n', buf->end - buf->start - scanned);
+
+        if (newline != NULL)
+        {
+            *line = buf->data + buf->start;
+            ssize_t line_len = newline - *line;
+            buf->start = newline - buf->data + 1;
+            return line_len;
+        }
+
+        scanned = buf->end - buf->start;
+        if (fill_buffer(buf, fd) <= 0)
+            return -1;
     }
+}
+
+ssize_t read_stdin_line(const char **line)
+{
+    return read_line(&stdin_buffer, STDIN_FILENO, line);
+}
+
+// EOF seen at the prompt. A terminal reports ^D to one read() only, so it has to be remembered; a
+// builtin reading its own input to ^D (read_stdin_line()) does not end the shell, and is not recorded.
+static bool stdin_eof = false;
+
+static bool line_buffered()
+{
+    if (stdin_buffer.data == NULL)
+        return false;
 
-    return line_size;
+    return memchr(stdin_buffer.data + stdin_buffer.start, '\n', stdin_buffer.end - stdin_buffer.start) != NULL;
 }
 
-char *copy_token_string(char *dest, Token *token)
+bool input_ready()
 {
-    if (token->string == NULL)
-        return NULL;
+    return stdin_eof || line_buffered();
+}
 
-    dest = (char *)malloc(token->size);
-    if (dest == NULL)
-        return NULL;
+ssize_t read_input()
+{
+    ssize_t n = fill_buffer(&stdin_buffer, STDIN_FILENO);
+    if (n <= 0)
+        stdin_eof = true;
+    return n;
+}
+
+void push_input(const char *data, size_t size)
+{
+    if (!make_room(&stdin_buffer, size))
+        return;
+    memcpy(stdin_buffer.data + stdin_buffer.end, data, size);
+    stdin_buffer.end += size;
+}
+
+void close_input()
+{
+    stdin_eof = true;
+}
+
+ssize_t read_command_line(const char **line)
+{
+    ssize_t line_len;
+
+    fflush(stdout); // the prompt has to be visible before blocking in read()
+
+    if ((stdin_eof && !line_buffered()) || (line_len = read_line(&stdin_buffer, STDIN_FILENO, line)) == -1)
+    {
+        printf("-shellman: scanning EOF terminates shellman.\n");
+        exit(EXIT_SUCCESS);
+    }
+    return line_len;
+}
 
-    strcpy(dest, token->string);
-    return dest;
+// Point at the job's own copy of the token's bytes and terminate it there.
+static char *token_string(Job *job, const char *line_start, Token *token)
+{
+    char *string = job->strings + (token->string - line_start);
+    string[token->size] = '\0';
+    return string;
 }
 
 // If failed to parse token, return -1 instead of 0
 int8_t parse(Job *job, Token *head_token)
 {
-    Token *cur_token;
+    Token *cur_token, *last_token = head_token;
     Process *cur_process = job->process_queue;
+    const char *line_start = head_token->string;
+
+    if (job->line == NULL)
+        return -1;
+
+    // Copy the whole line into the job once; every string of its processes points into that copy.
+    for (cur_token = head_token; cur_token->label != NONE; cur_token = cur_token->next)
+        last_token = cur_token;
+
+    size_t line_len = (last_token->string + last_token->size) - line_start;
+    memcpy(job->line, line_start, line_len);
+    job->line[line_len] = '\0';
+    memcpy(job->strings, line_start, line_len);
 
     for (cur_token = head_token; cur_token->label != NONE; cur_token = cur_token->next)
     {
@@ -141,29 +369,28 @@ int8_t parse(Job *job, Token *head_token)
         switch (cur_token->label)
         {
         case CMD: // <CMD> ( <ARG> <ARG> ... )
-            cur_process->cmd = copy_token_string(cur_process->cmd, cur_token);
+            cur_process->cmd = token_string(job, line_start, cur_token);
+            if (!push_arg(job->arena, cur_process, cur_process->cmd)) // argv[0]
+                return -1;
             break;
 
         case BUILTIN_CMD:
-            cur_process->cmd = copy_token_string(cur_process->cmd, cur_token);
+            cur_process->cmd = token_string(job, line_start, cur_token);
+            if (!push_arg(job->arena, cur_process, cur_process->cmd))
+                return -1;
             job->job_mode = BUILTIN_MODE;
             break;
 
         case ARG:
-            if (cur_token->arg_order - 1 >= MAX_ARG_SIZE)
-            {
-                printf("-shellman: a command's arguments are limited up to 8\n");
+            if (!push_arg(job->arena, cur_process, token_string(job, line_start, cur_token)))
                 return -1;
-            }
-
-            cur_process->args[cur_token->arg_order - 1] = copy_token_string(cur_process->args[cur_token->arg_order - 1], cur_token);
             break;
 
         case FILE_PATH:
             if (cur_token->prev->label == LEFT_REDIRECT)
-                cur_process->read_filepath = copy_token_string(cur_process->read_filepath, cur_token);
+                cur_process->read_filepath = token_string(job, line_start, cur_token);
             else if (cur_token->prev->label == RIGHT_REDIRECT)
-                cur_process->write_filepath = copy_token_string(cur_process->write_filepath, cur_token);
+                cur_process->write_filepath = token_string(job, line_start, cur_token);
 
             break;
 
@@ -174,7 +401,7 @@ int8_t parse(Job *job, Token *head_token)
                 return -1;
             }
 
-            cur_process = new_process(cur_process); // new_process() is invoked only here, because new CMD is guaranteed to come just after PIPE.
+            cur_process = new_process(job->arena, cur_process); // new_process() is invoked only here, because new CMD is guaranteed to come just after PIPE.
             break;
 
         case LEFT_REDIRECT:
@@ -185,6 +412,32 @@ int8_t parse(Job *job, Token *head_token)
             }
             break;
 
+        case HERE_DOC:
+        case HERE_STRING:
+            if (cur_token->next->label != HERE_WORD)
+            {
+                printf("-shellman: no word after '%s'.\n", cur_token->label == HERE_DOC ? "<<" : "<<<");
+                return -1;
+            }
+            break;
+
+        case HERE_WORD:
+            if (cur_token->prev->label == HERE_DOC)
+            {
+                cur_process->here_delimiter = token_string(job, line_start, cur_token);
+                cur_process->here_body = NULL;
+                break;
+            }
+
+            // a here-string is the word and a newline
+            cur_process->here_delimiter = NULL;
+            if ((cur_process->here_body = (char *)arena_alloc(job->arena, cur_token->size + 1)) == NULL)
+                return -1;
+            memcpy(cur_process->here_body, cur_token->string, cur_token->size);
+            cur_process->here_body[cur_token->size] = '\n';
+            cur_process->here_size = cur_token->size + 1;
+            break;
+
         case RIGHT_REDIRECT:
             if (cur_token->next->label == NONE)
             {
@@ -193,6 +446,16 @@ int8_t parse(Job *job, Token *head_token)
             }
             break;
 
+        case TIME: // "time" <CMD> ...
+            if (cur_token->next->label == NONE)
+            {
+                printf("-shellman: no command after time.\n");
+                return -1;
+            }
+
+            job->timed = true;
+            break;
+
         case BACKGROUND: // <CMD> ... "&"\n <--- "&" has to come to the end of input.
             if (cur_token->next->label != NONE)
             {
@@ -200,33 +463,17 @@ int8_t parse(Job *job, Token *head_token)
                 return -1;
             }
 
-            job->job_mode = BACK_MODE;
+            job->background = true;
+            if (job->job_mode != BUILTIN_MODE) // a builtin decides itself what '&' means for it
+                job->job_mode = BACK_MODE;
             break;
 
         default:
             break;
         }
 
-        if (job->line == NULL)
-            continue;
-        strcat(job->line, cur_token->string);
-        if (cur_token->next->label != NONE)
-            strcat(job->line, " ");
     }
 
     cur_process->next = NULL; // set dummy node
     return 0;
 }
-
-void free_token(Token *token)
-{
-    Token *cur_token, *next_token;
-    for (cur_token = token; cur_token != NULL; cur_token = next_token)
-    {
-        free_string(cur_token->string);
-
-        next_token = cur_token->next;
-        free(cur_token);
-        cur_token = NULL;
-    }
-}
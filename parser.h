@@ -7,11 +7,12 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "arena.h"
 #include "job.h"
 #include "process.h"
 #include "util.h"
 
-#define MAX_BUFFER_SIZE 256
+#define MAX_BUFFER_SIZE 256 // initial capacity of the line buffer; it grows for longer lines
 
 typedef enum tokenlabel
 {
@@ -23,25 +24,65 @@ typedef enum tokenlabel
     CMD,            // <CMD> ( <ARG> <ARG> ... )
     ARG,
     BUILTIN_CMD, // <BUILTIN_CMD> (<ARG> <ARG> ...)
-    FILE_PATH
+    FILE_PATH,
+    TIME, // "time" <CMD> ... <--- only as the first token of a line
+    HERE_DOC,    // <CMD> ... "<<" <HERE_WORD(delimiter)>, the body on the following lines
+    HERE_STRING, // <CMD> ... "<<<" <HERE_WORD(text)>
+    HERE_WORD
+
 } TokenLabel;
 
+/**
+ *
+ * A token is a (pointer, length) slice into the line it was read from.
+ * string is NOT NUL-terminated; parse() copies the whole line into the job once
+ * and terminates the slices there.
+ *
+**/
 typedef struct token
 {
     TokenLabel label;
     struct token *prev;
     struct token *next;
-    char *string;
-    int size;
-    int arg_order;
+    const char *string;
+    size_t size;
 } Token;
 
-Token *new_token(Token *cur_token);
-size_t tokenize(Token *token, char *buffer);
-size_t tokenize_line(Token *token);
-char *copy_token_string(char *dest, Token *token);
+// Tokens of a line are allocated from a per-line arena; reset the arena to free them.
+// Pass NULL as cur_token to allocate the head of a new list.
+Token *new_token(Arena *arena, Token *cur_token);
+
+typedef struct linebuffer
+{
+    char *data;
+    size_t capacity;
+    size_t start; // first byte not handed out yet
+    size_t end;   // one past the last byte read
+} LineBuffer;
+
+// Return the length of the next line of fd (without '\n') and point *line at it, or -1 on EOF.
+// *line is valid until the next call with the same buffer.
+ssize_t read_line(LineBuffer *buf, int fd, const char **line);
+// read_line() on the buffer the prompt reads from, for builtins consuming stdin
+ssize_t read_stdin_line(const char **line);
+void tokenize(Token *token, const char *string, size_t size);
+// Read one line from stdin (without '\n') and point *line at it, valid until the next read. Exit on EOF.
+ssize_t read_command_line(const char **line);
+// true if a complete line (or EOF) is buffered, so that read_command_line() will not block
+bool input_ready();
+// Read once from stdin into the line buffer. Return the number of bytes read, 0 on EOF, -1 on error.
+ssize_t read_input();
+// Append bytes to stdin's line buffer as if they had been read, e.g. a line from the line editor.
+void push_input(const char *data, size_t size);
+// Mark stdin as at EOF for the prompt.
+void close_input();
+// Tokenize a single line held in memory (no trailing newline required)
+size_t tokenize_string(Arena *arena, Token *token, const char *line, size_t line_len);
+// Name of the delimiter scanner in use ("avx2", "sse2" or "scalar").
+const char *tokenizer_backend();
+// Force a delimiter scanner. Return false if it is not supported on this CPU.
+bool set_tokenizer_backend(const char *name);
 // If failed to parse token, return -1 instead of 0
 int8_t parse(Job *job, Token *head_token);
-void free_token(Token *token);
 
 #endif
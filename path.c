@@ -0,0 +1,219 @@
+#include "path.h"
+
+static PathCache path_cache;
+
+static size_t hash_name(const char *name)
+{
+    size_t hash = 14695981039346656037ULL; // FNV-1a
+    for (; *name != '\0'; name++)
+    {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void stat_mtime(const char *dir, struct timespec *mtime)
+{
+    struct stat st;
+    if (stat(dir, &st) == -1)
+    {
+        mtime->tv_sec = -1; // a missing directory that appears later counts as a change
+        mtime->tv_nsec = 0;
+        return;
+    }
+    *mtime = st.st_mtim;
+}
+
+static bool dir_changed(PathDir *path_dir)
+{
+    struct timespec mtime;
+    if (path_dir->checked == path_cache.generation)
+        return false; // already checked for this line
+
+    stat_mtime(path_dir->dir, &mtime);
+    if (mtime.tv_sec != path_dir->mtime.tv_sec || mtime.tv_nsec != path_dir->mtime.tv_nsec)
+        return true;
+    path_dir->checked = path_cache.generation;
+    return false;
+}
+
+void flush_path_cache()
+{
+    for (size_t i = 0; i < path_cache.capacity; i++)
+    {
+        free(path_cache.entries[i].name);
+        free(path_cache.entries[i].path);
+    }
+    memset(path_cache.entries, 0, path_cache.capacity * sizeof(PathEntry));
+    path_cache.count = 0;
+
+    for (size_t i = 0; i < path_cache.n_dirs; i++)
+    {
+        stat_mtime(path_cache.dirs[i].dir, &path_cache.dirs[i].mtime);
+        path_cache.dirs[i].checked = path_cache.generation;
+    }
+}
+
+void new_path_generation()
+{
+    path_cache.generation++;
+}
+
+// Split $PATH into directories. An empty component means the current directory.
+static void load_path_env(const char *path_env)
+{
+    for (size_t i = 0; i < path_cache.n_dirs; i++)
+        free(path_cache.dirs[i].dir);
+    free(path_cache.dirs);
+    free(path_cache.path_env);
+
+    path_cache.path_env = strdup(path_env);
+    path_cache.n_dirs = 1;
+    for (const char *c = path_env; *c != '\0'; c++)
+        path_cache.n_dirs += (*c == ':');
+    path_cache.dirs = (PathDir *)calloc(path_cache.n_dirs, sizeof(PathDir));
+
+    const char *start = path_env;
+    for (size_t i = 0; i < path_cache.n_dirs; i++)
+    {
+        const char *end = strchr(start, ':');
+        size_t len = end != NULL ? (size_t)(end - start) : strlen(start);
+
+        path_cache.dirs[i].dir = len > 0 ? strndup(start, len) : strdup(".");
+        start += len + 1;
+    }
+
+    flush_path_cache();
+}
+
+static PathEntry *find_slot(const char *name)
+{
+    size_t mask = path_cache.capacity - 1;
+    for (size_t i = hash_name(name) & mask;; i = (i + 1) & mask)
+    {
+        PathEntry *entry = &path_cache.entries[i];
+        if (entry->name == NULL || strcmp(entry->name, name) == 0)
+            return entry;
+    }
+}
+
+static void grow_table()
+{
+    PathEntry *old_entries = path_cache.entries;
+    size_t old_capacity = path_cache.capacity;
+
+    path_cache.capacity = old_capacity ? old_capacity * 2 : 64;
+    path_cache.entries = (PathEntry *)calloc(path_cache.capacity, sizeof(PathEntry));
+
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old_entries[i].name != NULL)
+            *find_slot(old_entries[i].name) = old_entries[i];
+    }
+    free(old_entries);
+}
+
+static PathEntry *insert_entry(const char *name)
+{
+    if (path_cache.count >= PATH_CACHE_MAX_ENTRIES)
+        flush_path_cache();
+    if ((path_cache.count + 1) * 4 > path_cache.capacity * 3)
+        grow_table();
+
+    PathEntry *entry = find_slot(name);
+    entry->name = strdup(name);
+    entry->path = NULL;
+    entry->dir_index = -1;
+    entry->hits = 0;
+    path_cache.count++;
+
+    for (size_t i = 0; i < path_cache.n_dirs; i++)
+    {
+        size_t len = strlen(path_cache.dirs[i].dir) + strlen(name) + 2;
+        char *path = (char *)malloc(len);
+        struct stat st;
+
+        snprintf(path, len, "%s/%s", path_cache.dirs[i].dir, name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0)
+        {
+            entry->path = path;
+            entry->dir_index = i;
+            break;
+        }
+        free(path);
+    }
+
+    return entry;
+}
+
+static bool entry_valid(PathEntry *entry)
+{
+    size_t last = entry->path != NULL ? (size_t)entry->dir_index : path_cache.n_dirs - 1;
+    for (size_t i = 0; i <= last; i++)
+    {
+        if (dir_changed(&path_cache.dirs[i]))
+            return false;
+    }
+    return true;
+}
+
+static PathEntry *lookup(const char *name)
+{
+    const char *path_env = getenv("PATH");
+    if (path_env == NULL)
+        path_env = DEFAULT_PATH;
+
+    if (path_cache.path_env == NULL || strcmp(path_cache.path_env, path_env) != 0)
+        load_path_env(path_env);
+    if (path_cache.capacity == 0)
+        grow_table();
+
+    PathEntry *entry = find_slot(name);
+    if (entry->name != NULL && !entry_valid(entry))
+    {
+        flush_path_cache();
+        entry = find_slot(name);
+    }
+
+    if (entry->name == NULL)
+        entry = insert_entry(name);
+
+    entry->hits++;
+    return entry;
+}
+
+const char *resolve_command(const char *cmd)
+{
+    if (strchr(cmd, '/') != NULL)
+        return cmd;
+
+    return lookup(cmd)->path;
+}
+
+/* builtin command */
+
+void hash(char **args)
+{
+    if (args[0] != NULL && strcmp(args[0], "-r") == 0)
+    {
+        flush_path_cache();
+        return;
+    }
+
+    for (size_t i = 0; args[i] != NULL; i++)
+    {
+        if (resolve_command(args[i]) == NULL)
+            printf("-shellman: hash: %s: not found\n", args[i]);
+    }
+    if (args[0] != NULL)
+        return;
+
+    printf("hits\tcommand\n");
+    for (size_t i = 0; i < path_cache.capacity; i++)
+    {
+        PathEntry *entry = &path_cache.entries[i];
+        if (entry->name != NULL && entry->path != NULL)
+            printf("%4u\t%s\n", entry->hits, entry->path);
+    }
+}
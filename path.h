@@ -0,0 +1,65 @@
+#ifndef path_h
+#define path_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+#define PATH_CACHE_MAX_ENTRIES 4096 // the cache is flushed when it grows past this
+
+/**
+ *
+ * Command name -> executable path cache, like the `hash` builtin of bash.
+ * Misses are cached too, as entries whose path is NULL.
+ *
+ * An entry found in the k-th PATH directory stays valid as long as the mtimes of
+ * directories 0..k are unchanged (nothing was added in front of it, and it was not
+ * removed); a miss stays valid as long as no PATH directory changed.
+ * A changed directory or a changed $PATH flushes the whole cache.
+ *
+ * The mtimes are checked once per line, not once per lookup: every line starts a
+ * new generation (new_path_generation()), and a directory found unchanged is not
+ * stat()ed again before the next one. The stages of a pipeline, and the tasks of
+ * a pool, resolve for the price of a hash lookup.
+ *
+**/
+typedef struct pathentry
+{
+    char *name; // NULL if the slot is empty
+    char *path; // NULL for a cached miss
+    int dir_index;
+    unsigned int hits;
+} PathEntry;
+
+typedef struct pathdir
+{
+    char *dir;
+    struct timespec mtime;
+    unsigned long checked; // generation in which mtime was last found current
+} PathDir;
+
+typedef struct pathcache
+{
+    char *path_env; // $PATH the directories were split from
+    PathDir *dirs;
+    size_t n_dirs;
+    PathEntry *entries;
+    size_t capacity; // always a power of 2
+    size_t count;
+    unsigned long generation; // of the line being run
+} PathCache;
+
+// Return the executable path for cmd, or NULL if it is not found in $PATH.
+// A cmd containing '/' is returned unchanged. The result is owned by the cache.
+const char *resolve_command(const char *cmd);
+void flush_path_cache();
+// A new line: the PATH directories are checked again, each at most once until the next line.
+void new_path_generation();
+
+void hash(char **args);
+
+#endif
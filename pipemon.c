@@ -0,0 +1,258 @@
+#define _GNU_SOURCE // pipe2(), splice(), F_SETPIPE_SZ
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "pipemon.h"
+
+static uint64_t now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint64_t load(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static void set_pipe_size(Job *job, int fd)
+{
+    if (job->pipe_size == 0 || fcntl(fd, F_SETPIPE_SZ, job->pipe_size) != -1)
+        return;
+
+    printf("-shellman: pipes: F_SETPIPE_SZ %d: %s (see /proc/sys/fs/pipe-max-size)\n", job->pipe_size,
+           strerror(errno));
+    job->pipe_size = 0; // the other pipes of the job would fail the same way
+}
+
+void open_stage_pipe(Job *job, Process *process, size_t edge)
+{
+    int pipe_fd[2], relay_fd[2];
+
+    // With relays, the shell holds pipe ends across several spawns: only dup2() may pass them on.
+    if (pipe2(pipe_fd, job->edges != NULL ? O_CLOEXEC : 0) == -1)
+    {
+        perror("-shellman: pipe");
+        return;
+    }
+    set_pipe_size(job, pipe_fd[1]);
+    process->write_fd = pipe_fd[1];
+
+    if (job->edges == NULL || pipe2(relay_fd, O_CLOEXEC) == -1)
+    {
+        process->next->read_fd = pipe_fd[0];
+        return;
+    }
+    set_pipe_size(job, relay_fd[1]);
+    process->next->read_fd = relay_fd[0];
+
+    process->relay_fds[0] = pipe_fd[0];
+    process->relay_fds[1] = relay_fd[1];
+    job->edges[edge].capacity = fcntl(relay_fd[1], F_GETPIPE_SZ);
+}
+
+static void close_relay_fds(Process *process)
+{
+    if (process->relay_fds[0] == 0)
+        return;
+    close(process->relay_fds[0]);
+    close(process->relay_fds[1]);
+    process->relay_fds[0] = process->relay_fds[1] = 0;
+}
+
+// Body of a relay process: move everything from the output of process to the input of the next stage, then exit.
+static void relay(Job *job, Process *process, PipeEdge *edge)
+{
+    int in_fd = process->relay_fds[0], out_fd = process->relay_fds[1];
+
+    set_default();
+    signal(SIGPIPE, SIG_IGN); // a downstream stage that exits is EPIPE, and the end of the relay
+    setpgid(0, job->pgid);
+
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+    {
+        if (cur_proc != process)
+            close_relay_fds(cur_proc); // or the stages of those edges would never see EOF
+    }
+
+    while (1)
+    {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, PIPE_EDGE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            __atomic_fetch_add(&edge->bytes, n, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EINTR))
+            break; // EOF from upstream, or downstream gone
+
+        // Nothing moved: find out which side to wait for, and account the wait to it.
+        struct pollfd upstream = {in_fd, POLLIN, 0};
+        bool stalled = poll(&upstream, 1, 0) > 0;
+        struct pollfd wait_for = stalled ? (struct pollfd){out_fd, POLLOUT, 0} : upstream;
+
+        uint64_t start = now_ns();
+        if (poll(&wait_for, 1, -1) == -1 && errno != EINTR)
+            break;
+        __atomic_fetch_add(stalled ? &edge->stall_ns : &edge->idle_ns, now_ns() - start, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&edge->end_ns, now_ns(), __ATOMIC_RELAXED);
+    _exit(0);
+}
+
+void start_relays(Job *job)
+{
+    size_t edge = 0;
+    for (Process *process = job->process_queue; process->next != NULL; process = process->next, edge++)
+    {
+        if (process->relay_fds[0] == 0)
+            continue;
+
+        if (job->pgid != 0) // else no stage was launched: nothing to relay for
+            job->edges[edge].start_ns = now_ns();
+        pid_t pid = job->pgid != 0 ? fork() : -1;
+        if (pid == 0)
+            relay(job, process, &job->edges[edge]);
+        else if (pid == -1 && job->pgid != 0)
+        {
+            perror("-shellman: pipes: fork");
+            job->edges[edge].start_ns = 0;
+        }
+        else if (pid > 0 && setpgid(pid, job->pgid) == -1 && errno != EACCES)
+            perror("-shellman: pipes: setpgid");
+
+        close_relay_fds(process);
+    }
+}
+
+static PipeEdge *new_pipe_edges(size_t n_edges)
+{
+    PipeEdge *edges = (PipeEdge *)mmap(NULL, n_edges * sizeof(PipeEdge), PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return edges != MAP_FAILED ? edges : NULL;
+}
+
+void close_relay_ends(Job *job)
+{
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+        close_relay_fds(cur_proc);
+}
+
+void free_pipe_edges(Job *job)
+{
+    close_relay_ends(job); // run_job() stopped before the relays were started
+    munmap(job->edges, job->n_edges * sizeof(PipeEdge));
+    job->edges = NULL;
+    job->n_edges = 0;
+}
+
+static void print_size(FILE *stream, double bytes, const char *unit)
+{
+    static const char *prefixes[] = {"", "Ki", "Mi", "Gi", "Ti"};
+    size_t i = 0;
+
+    while (bytes >= 1024 && i + 1 < sizeof(prefixes) / sizeof(char *))
+    {
+        bytes /= 1024;
+        i++;
+    }
+    fprintf(stream, "%7.1f %s%s", bytes, prefixes[i], unit);
+}
+
+void print_pipe_edges(FILE *stream, Job *job)
+{
+    Process *upstream = job->process_queue;
+
+    for (size_t i = 0; i < job->n_edges; i++, upstream = upstream->next)
+    {
+        PipeEdge *edge = &job->edges[i];
+        uint64_t start = load(&edge->start_ns), end = load(&edge->end_ns);
+
+        fprintf(stream, "    %-12s -> %-12s ", upstream->cmd, upstream->next->cmd);
+        if (start == 0)
+        {
+            fprintf(stream, "not relayed\n");
+            continue;
+        }
+
+        double seconds = ((end != 0 ? end : now_ns()) - start) / 1e9;
+        double stall = load(&edge->stall_ns) / 1e9, idle = load(&edge->idle_ns) / 1e9;
+        double bytes = load(&edge->bytes);
+
+        print_size(stream, bytes, "B");
+        print_size(stream, seconds > 0 ? bytes / seconds : 0.0, "B/s");
+        fprintf(stream, "  stall %.3fs (%.0f%%) idle %.3fs (%.0f%%)  pipe %d KiB%s\n", stall,
+                seconds > 0 ? 100 * stall / seconds : 0.0, idle, seconds > 0 ? 100 * idle / seconds : 0.0,
+                edge->capacity / 1024, end != 0 ? "" : "  relaying");
+    }
+}
+
+/* builtin command */
+
+// Bytes, with an optional K or M suffix. Return -1 if invalid.
+static long parse_size(const char *string)
+{
+    char *end;
+    long size = strtol(string, &end, 10);
+
+    if (*end == 'K' || *end == 'k')
+        size *= 1024, end++;
+    else if (*end == 'M' || *end == 'm')
+        size *= 1024 * 1024, end++;
+
+    return *end == '\0' && size > 0 && size <= INT_MAX ? size : -1;
+}
+
+void pipes(Process *command)
+{
+    static const char usage[] = "pipes -s 1M -m producer | filter | consumer";
+    char **args = command->args + 1;
+    long pipe_size = 0;
+    bool monitor = false;
+    size_t i;
+
+    for (i = 0; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0' && args[i][2] == '\0'; i++)
+    {
+        if (args[i][1] == 'm')
+            monitor = true;
+        else if (args[i][1] == 's' && args[i + 1] != NULL && (pipe_size = parse_size(args[i + 1])) != -1)
+            i++;
+        else
+            break;
+    }
+
+    if (args[i] == NULL || args[i][0] == '-' || (!monitor && pipe_size == 0))
+    {
+        printf("-shellman: pipes example usage: `%s`\n", usage);
+        return;
+    }
+
+    size_t line_offset;
+    Job *job = copy_rest_of_line(command->job, i + 1, &line_offset);
+    if (job == NULL)
+    {
+        perror("-shellman: pipes: new_job");
+        return;
+    }
+    job->line += line_offset; // just the pipeline, for `jobs` and notices
+    job->pipe_size = (int)pipe_size;
+
+    for (Process *cur_proc = job->process_queue->next; cur_proc != NULL; cur_proc = cur_proc->next)
+        job->n_edges++;
+    if (monitor && job->n_edges > 0 && (job->edges = new_pipe_edges(job->n_edges)) == NULL)
+    {
+        perror("-shellman: pipes: mmap");
+        free_job(job);
+        return;
+    }
+    if (job->edges == NULL)
+        job->n_edges = 0;
+
+    launch_job(job);
+}
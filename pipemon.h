@@ -0,0 +1,68 @@
+#ifndef pipemon_h
+#define pipemon_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+
+/**
+ *
+ * `pipes [-s SIZE] [-m] CMD [ARG ...] | CMD ... [&]`
+ *
+ * Runs the rest of the line as a job of its own whose pipes differ from those
+ * of a typed line.
+ *
+ * -s sets the capacity of every pipe of the pipeline with F_SETPIPE_SZ (SIZE in
+ * bytes, or with a K or M suffix) instead of the default 64 KiB: a stage that
+ * writes in large bursts then blocks less often on a slower reader. The kernel
+ * rounds it up to a power of two pages, and refuses more than
+ * /proc/sys/fs/pipe-max-size to unprivileged users.
+ *
+ * -m monitors the pipeline: each edge between two stages becomes two pipes with
+ * a relay process of the shell in between, which moves the bytes across with
+ * splice() (no copy to user space) and counts them. When a splice cannot move
+ * anything, the relay polls for the side it is waiting on and accounts the time:
+ *
+ *   stall  the pipe to the downstream stage is full: that stage is the bottleneck
+ *   idle   the pipe from the upstream stage is empty: the upstream one is
+ *
+ * The counters live in a shared anonymous mapping, so `jobs -p` shows them live
+ * while the job runs, and they are printed to stderr once it is over. The relays
+ * join the job's process group, so ^C and ^Z reach them with the stages; the
+ * shell reaps them without tracking them as processes of the job.
+ *
+**/
+
+#define PIPE_EDGE_CHUNK (1 << 20) // upper bound of one splice(); the pipe capacity bounds it anyway
+
+typedef struct pipeedge
+{
+    // written by the relay
+    uint64_t bytes;
+    uint64_t stall_ns; // waiting for room in the downstream pipe
+    uint64_t idle_ns;  // waiting for data in the upstream pipe
+    uint64_t start_ns; // CLOCK_MONOTONIC
+    uint64_t end_ns;   // 0 while relaying
+    // written by the shell before the relay starts
+    int capacity; // of the downstream pipe
+} PipeEdge;
+
+// Open the pipe from process to the next stage: a direct one, or one through a relay if the job is monitored.
+void open_stage_pipe(Job *job, Process *process, size_t edge);
+// Fork the relays of a monitored job once its stages are launched.
+void start_relays(Job *job);
+// Close the relay ends of every edge the shell still holds: in a stage that does not exec, they would keep
+// the pipes of the job open (exec closes them).
+void close_relay_ends(Job *job);
+void free_pipe_edges(Job *job);
+// Throughput, stall and idle time of every edge of a monitored job.
+void print_pipe_edges(FILE *stream, Job *job);
+
+void pipes(Process *command);
+
+#endif
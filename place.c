@@ -0,0 +1,348 @@
+#define _GNU_SOURCE // cpu_set_t, sched_setaffinity(), SCHED_BATCH, SCHED_IDLE
+
+#include <dirent.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "place.h"
+
+typedef enum spread
+{
+    SPREAD_NONE,
+    SPREAD_CORES,
+    SPREAD_NODES
+} Spread;
+
+typedef struct placement
+{
+    cpu_set_t cpus;   // of the job: -c, or those of the shell
+    bool restricted;  // -c was given
+    Spread spread;
+    cpu_set_t *stage_cpus; // one set per stage if spread, in the job's arena
+    size_t n_stages;
+    int nice;
+    bool renice; // -n was given
+    int policy;  // SCHED_OTHER: left as it is
+} Placement;
+
+static const char *spread_names[] = {"none", "cores", "nodes"};
+
+/* cpulists */
+
+// Parse a cpulist such as "0-3,8,10-11" (sysfs, -c). Return false if malformed or empty.
+static bool parse_cpu_list(const char *list, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    while (*list != '\0' && *list != '\n')
+    {
+        char *end;
+        long first = strtol(list, &end, 10), last = first;
+        if (end == list)
+            return false;
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list)
+                return false;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+
+        list = end;
+        if (*list == ',')
+            list++;
+        else if (*list != '\0' && *list != '\n')
+            return false;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+static bool read_cpu_list(const char *filepath, cpu_set_t *cpus)
+{
+    char list[4096];
+    FILE *file = fopen(filepath, "r");
+    if (file == NULL)
+        return false;
+
+    bool read = fgets(list, sizeof(list), file) != NULL;
+    fclose(file);
+    return read && parse_cpu_list(list, cpus);
+}
+
+static void print_cpu_list(FILE *stream, const cpu_set_t *cpus)
+{
+    const char *separator = "";
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, cpus))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+            last++;
+
+        if (last == cpu)
+            fprintf(stream, "%s%d", separator, cpu);
+        else
+            fprintf(stream, "%s%d-%d", separator, cpu, last);
+        separator = ",";
+        cpu = last;
+    }
+}
+
+/* spreading */
+
+// First hardware thread of the physical core of cpu: itself if its topology is unknown.
+static int core_of(int cpu)
+{
+    char filepath[128];
+    cpu_set_t siblings;
+
+    snprintf(filepath, sizeof(filepath), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if (!read_cpu_list(filepath, &siblings))
+        return cpu;
+
+    for (int sibling = 0; sibling < CPU_SETSIZE; sibling++)
+    {
+        if (CPU_ISSET(sibling, &siblings))
+            return sibling;
+    }
+    return cpu;
+}
+
+// CPUs of the set in the order stages take them: one thread per physical core, then the other threads.
+static size_t order_by_core(const cpu_set_t *cpus, int *order)
+{
+    size_t n = 0;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, cpus) && (core_of(cpu) == cpu) == (pass == 0))
+                order[n++] = cpu;
+        }
+    }
+    return n;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// The CPUs of the set on each NUMA node, by node number, skipping the nodes without any.
+static size_t split_by_node(const cpu_set_t *cpus, cpu_set_t *nodes)
+{
+    int ids[MAX_NUMA_NODES];
+    size_t n_ids = 0, n_nodes = 0;
+    DIR *dir = opendir("/sys/devices/system/node");
+
+    if (dir != NULL)
+    {
+        struct dirent *entry;
+        int id;
+        while ((entry = readdir(dir)) != NULL && n_ids < MAX_NUMA_NODES)
+        {
+            if (sscanf(entry->d_name, "node%d", &id) == 1)
+                ids[n_ids++] = id;
+        }
+        closedir(dir);
+    }
+    qsort(ids, n_ids, sizeof(int), compare_ints);
+
+    for (size_t i = 0; i < n_ids; i++)
+    {
+        char filepath[128];
+        snprintf(filepath, sizeof(filepath), "/sys/devices/system/node/node%d/cpulist", ids[i]);
+        if (!read_cpu_list(filepath, &nodes[n_nodes]))
+            continue; // e.g. a memory-only node
+        CPU_AND(&nodes[n_nodes], &nodes[n_nodes], cpus);
+        if (CPU_COUNT(&nodes[n_nodes]) > 0)
+            n_nodes++;
+    }
+
+    if (n_nodes == 0) // no NUMA information: a single node
+        nodes[n_nodes++] = *cpus;
+    return n_nodes;
+}
+
+static bool spread_stages(Job *job, Placement *placement)
+{
+    placement->stage_cpus = (cpu_set_t *)arena_alloc(job->arena, placement->n_stages * sizeof(cpu_set_t));
+    if (placement->stage_cpus == NULL)
+        return false;
+
+    if (placement->spread == SPREAD_CORES)
+    {
+        int order[CPU_SETSIZE];
+        size_t n_cpus = order_by_core(&placement->cpus, order);
+        for (size_t i = 0; i < placement->n_stages; i++)
+        {
+            CPU_ZERO(&placement->stage_cpus[i]);
+            CPU_SET(order[i % n_cpus], &placement->stage_cpus[i]);
+        }
+        return true;
+    }
+
+    cpu_set_t *nodes = (cpu_set_t *)malloc(MAX_NUMA_NODES * sizeof(cpu_set_t));
+    if (nodes == NULL)
+        return false;
+    size_t n_nodes = split_by_node(&placement->cpus, nodes);
+    for (size_t i = 0; i < placement->n_stages; i++)
+        placement->stage_cpus[i] = nodes[i % n_nodes];
+    free(nodes);
+    return true;
+}
+
+static const cpu_set_t *cpus_of(const Process *process)
+{
+    const Placement *placement = process->job->placement;
+    if (placement->spread == SPREAD_NONE)
+        return &placement->cpus;
+
+    size_t stage = 0;
+    for (const Process *cur_proc = process->job->process_queue; cur_proc != process; cur_proc = cur_proc->next)
+        stage++;
+    return &placement->stage_cpus[stage];
+}
+
+/* applying and showing */
+
+void apply_placement(Process *process)
+{
+    const Placement *placement = process->job->placement;
+
+    if ((placement->restricted || placement->spread != SPREAD_NONE) &&
+        sched_setaffinity(0, sizeof(cpu_set_t), cpus_of(process)) == -1)
+        perror("-shellman: place: sched_setaffinity");
+
+    if (placement->policy != SCHED_OTHER)
+    {
+        struct sched_param param = {.sched_priority = 0};
+        if (sched_setscheduler(0, placement->policy, &param) == -1)
+            perror("-shellman: place: sched_setscheduler");
+    }
+
+    if (placement->renice && setpriority(PRIO_PROCESS, 0, placement->nice) == -1)
+        perror("-shellman: place: setpriority"); // e.g. a level below the current one without CAP_SYS_NICE
+}
+
+void print_placement(FILE *stream, const Job *job)
+{
+    const Placement *placement = job->placement;
+
+    fprintf(stream, " [cpus ");
+    print_cpu_list(stream, &placement->cpus);
+    if (placement->spread != SPREAD_NONE)
+        fprintf(stream, ", spread %s", spread_names[placement->spread]);
+    if (placement->renice)
+        fprintf(stream, ", nice %d", placement->nice);
+    if (placement->policy == SCHED_BATCH)
+        fprintf(stream, ", SCHED_BATCH");
+    else if (placement->policy == SCHED_IDLE)
+        fprintf(stream, ", SCHED_IDLE");
+    fprintf(stream, "]");
+}
+
+void print_stage_cpus(FILE *stream, const Process *process)
+{
+    fprintf(stream, " cpus ");
+    print_cpu_list(stream, cpus_of(process));
+}
+
+/* builtin command */
+
+void place(Process *command)
+{
+    static const char usage[] = "place -c 4-63 -s cores -n 10 -b producer | filter | consumer";
+    char **args = command->args + 1;
+    Placement placement = {.spread = SPREAD_NONE, .policy = SCHED_OTHER};
+    bool valid = true;
+    size_t i;
+
+    for (i = 0; valid && args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0' && args[i][2] == '\0'; i++)
+    {
+        char option = args[i][1], *value = args[i + 1];
+
+        if (option == 'b' || option == 'i')
+        {
+            placement.policy = option == 'b' ? SCHED_BATCH : SCHED_IDLE;
+            continue;
+        }
+        if (value == NULL || strchr("csn", option) == NULL)
+        {
+            valid = false;
+            break;
+        }
+
+        switch (option)
+        {
+        case 'c':
+            valid = placement.restricted = parse_cpu_list(value, &placement.cpus);
+            break;
+        case 's':
+            placement.spread = strcmp(value, "cores") == 0   ? SPREAD_CORES
+                               : strcmp(value, "nodes") == 0 ? SPREAD_NODES
+                                                             : SPREAD_NONE;
+            valid = placement.spread != SPREAD_NONE;
+            break;
+        case 'n':
+            placement.nice = atoi(value);
+            placement.renice = true;
+            valid = placement.nice >= -20 && placement.nice <= 19;
+            break;
+        }
+        i++;
+    }
+
+    if (!valid || args[i] == NULL || args[i][0] == '-')
+    {
+        printf("-shellman: place example usage: `%s`\n", usage);
+        return;
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == -1)
+    {
+        perror("-shellman: place: sched_getaffinity");
+        return;
+    }
+    if (!placement.restricted)
+    {
+        placement.cpus = allowed;
+    }
+    else
+    {
+        CPU_AND(&allowed, &allowed, &placement.cpus);
+        if (!CPU_EQUAL(&allowed, &placement.cpus))
+            printf("-shellman: place: warning: some of the CPUs are offline or outside the shell's own set\n");
+    }
+
+    size_t line_offset;
+    Job *job = copy_rest_of_line(command->job, i + 1, &line_offset);
+    if (job == NULL || (job->placement = (Placement *)arena_alloc(job->arena, sizeof(Placement))) == NULL)
+    {
+        perror("-shellman: place: new_job");
+        if (job != NULL)
+            free_job(job);
+        return;
+    }
+    job->line += line_offset; // just the pipeline, for `jobs` and notices
+
+    *job->placement = placement;
+    for (Process *cur_proc = job->process_queue; cur_proc != NULL; cur_proc = cur_proc->next)
+        job->placement->n_stages++;
+    if (placement.spread != SPREAD_NONE && !spread_stages(job, job->placement))
+    {
+        perror("-shellman: place: spread");
+        free_job(job);
+        return;
+    }
+
+    launch_job(job);
+}
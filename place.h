@@ -0,0 +1,49 @@
+#ifndef place_h
+#define place_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+
+#define MAX_NUMA_NODES 256
+
+/**
+ *
+ * `place [-c CPULIST] [-s cores|nodes] [-n NICE] [-b | -i] CMD [ARG ...] | CMD ... [&]`
+ *
+ * Runs the rest of the line as a job of its own whose processes are placed:
+ *
+ * -c  CPUs the job may run on, in the cpulist format of sysfs ("0-3,8,10-11"),
+ *     e.g. to keep it off cores reserved for latency-critical services.
+ *     Without it, the CPUs the shell may run on.
+ * -s  spread the stages of the pipeline over those CPUs instead of letting the
+ *     scheduler move all of them around: `cores` pins stage i to the i-th CPU,
+ *     one hardware thread per physical core first (thread_siblings_list), and
+ *     `nodes` binds stage i to the CPUs of the i-th NUMA node (node*\/cpulist),
+ *     both wrapping around when there are more stages.
+ * -n  nice level of every process, as setpriority(2) sets it.
+ * -b  SCHED_BATCH: CPU-bound, no wakeup preference over interactive tasks.
+ * -i  SCHED_IDLE: only CPU time nobody else wants.
+ *
+ * The shell reads sysfs and works out the CPUs of each stage once; each stage
+ * applies its placement to itself in the forked child right after
+ * set_default(), before it execs, so nothing it runs ever executes elsewhere.
+ * A placed job therefore always uses the fork backend. `jobs` shows the
+ * placement of the job, `jobs -l` the CPUs of each stage.
+ *
+**/
+
+// Place the calling process, a stage of a placed job, as its job asks. Run in the child after set_default().
+void apply_placement(Process *process);
+// e.g. " [cpus 4-63, spread cores, nice 10, SCHED_BATCH]"
+void print_placement(FILE *stream, const Job *job);
+// e.g. " cpus 4", the CPUs the stage is bound to
+void print_stage_cpus(FILE *stream, const Process *process);
+
+void place(Process *command);
+
+#endif
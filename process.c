@@ -1,11 +1,36 @@
 #include "process.h"
 
-Process *new_process(Process *cur_process)
+Process *new_process(Arena *arena, Process *cur_process)
 {
-    Process *new_process = (Process *)calloc(1, sizeof(Process));
+    Process *new_process = (Process *)arena_alloc(arena, sizeof(Process));
     if (new_process == NULL)
         return NULL;
 
     cur_process->next = new_process;
     return new_process;
 }
+
+bool push_arg(Arena *arena, Process *process, char *arg)
+{
+    if (process->args == NULL)
+    {
+        process->args = process->inline_args;
+        process->args_capacity = INLINE_ARGS;
+    }
+
+    if (process->n_args + 1 == process->args_capacity)
+    {
+        size_t capacity = process->args_capacity * 2;
+        char **args = (char **)arena_alloc(arena, capacity * sizeof(char *));
+        if (args == NULL)
+            return false;
+
+        memcpy(args, process->args, process->n_args * sizeof(char *));
+        process->args = args; // the outgrown array stays in the arena until the job is freed
+        process->args_capacity = capacity;
+    }
+
+    process->args[process->n_args++] = arg;
+    process->args[process->n_args] = NULL;
+    return true;
+}
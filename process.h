@@ -1,25 +1,44 @@
 #ifndef process_h
 #define process_h
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#define MAX_ARG_SIZE 8
+#include "arena.h"
+#include "usage.h"
+
+#define INLINE_ARGS 8 // argv slots inside the Process; a longer argv moves to the job's arena
+
+struct job;
 
 typedef struct process
 {
     pid_t pid;
+    int pidfd; // 0 if the process is not watched by the event loop
+    struct job *job;
     struct process *next;
     char *cmd;
-    char *args[MAX_ARG_SIZE];
+    char **args;          // argv: cmd, its arguments and NULL. NULL until push_arg() is called.
+    size_t n_args;        // not counting the NULL
+    size_t args_capacity; // including the NULL
+    char *inline_args[INLINE_ARGS];
     char *read_filepath;
     char *write_filepath;
+    char *here_delimiter; // WORD of "<<WORD": the body is read after the line
+    char *here_body;      // stdin from a here-document or here-string, in the job's arena, or NULL
+    size_t here_size;
     int read_fd;
     int write_fd;
+    int relay_fds[2]; // monitored pipeline: the relay's ends of the two pipes to the next stage, 0 once it has them
     int status;
+    Usage usage;
 } Process;
 
-Process *new_process(Process *cur_process);
+Process *new_process(Arena *arena, Process *cur_process);
+// Append arg to the argv of process, and keep it NULL-terminated.
+// Return false if argv had to grow and the arena could not provide the space.
+bool push_arg(Arena *arena, Process *process, char *arg);
 
 #endif
@@ -0,0 +1,780 @@
+#define _GNU_SOURCE // accept4(), pipe2(), memfd_create()
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "shell.h"
+
+typedef enum endpointkind
+{
+    LISTENER,
+    CLIENT,
+    OUTPUT
+} EndpointKind;
+
+// What an epoll_event.data.ptr of the daemon's epoll instance points at.
+typedef struct endpoint
+{
+    EndpointKind kind;
+    int fd;
+} Endpoint;
+
+struct request;
+
+typedef struct client
+{
+    Endpoint endpoint;
+    char *in; // received bytes, up to a whole frame
+    size_t in_size;
+    size_t in_capacity;
+    char *out; // frames not sent yet
+    size_t out_size;
+    size_t out_capacity;
+    bool input_closed;  // the client shut down its writing side
+    bool output_paused; // too much unsent: the job pipes are not read
+    bool hung_up;       // gone: its requests run to the end, their responses discarded
+    bool closing;       // dropped: freed by release_clients() once nothing on the stack uses it
+    struct request *requests;
+    struct client *next_closing;
+} Client;
+
+typedef struct request
+{
+    Endpoint output; // read end of the capture pipe, fd -1 if none or drained
+    Client *client;  // NULL once the client has hung up
+    uint32_t tag;
+    Job *job; // NULL once it is over
+    bool held; // its builtin is still running: the exit waits for what the builtin printed
+    char exit_report[256];
+    struct request *next;
+} Request;
+
+static int server_fd = -1; // the daemon's epoll instance
+static Endpoint listener = {LISTENER, -1};
+static int depth = 0;                   // server_ready() and request_done() calls on the stack
+static Client *closing_clients = NULL; // dropped, to be freed once depth is back to 0
+
+// Here-document bodies of the run request being started.
+static const char *body_cur = NULL, *body_end = NULL;
+
+// The builtin running for a request, which adopt_job() hands the job it launches.
+static Client *builtin_client = NULL;
+static uint32_t builtin_tag;
+static bool builtin_capture;
+static Request *adopted = NULL;
+
+static void drop_client(Client *client);
+
+/* sending */
+
+static void update_client_events(Client *client)
+{
+    struct epoll_event ev;
+    if (client->hung_up)
+        return; // no longer watched
+    ev.events = (client->input_closed ? 0 : EPOLLIN) | (client->out_size > 0 ? EPOLLOUT : 0);
+    ev.data.ptr = &client->endpoint;
+    epoll_ctl(server_fd, EPOLL_CTL_MOD, client->endpoint.fd, &ev);
+}
+
+static void watch_output(Request *request, bool watch)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &request->output;
+    epoll_ctl(server_fd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, request->output.fd, &ev);
+}
+
+// Stop or resume reading the output of the client's jobs, which then wait in their pipes.
+static void pause_output(Client *client, bool pause)
+{
+    if (client->output_paused == pause)
+        return;
+
+    client->output_paused = pause;
+    for (Request *request = client->requests; request != NULL; request = request->next)
+    {
+        if (request->output.fd != -1)
+            watch_output(request, !pause);
+    }
+}
+
+// Send what the socket takes now. Return false if the client is gone.
+static bool flush_client(Client *client)
+{
+    size_t sent = 0;
+
+    if (client->closing)
+        return false;
+    if (client->hung_up)
+        return true;
+
+    while (sent < client->out_size)
+    {
+        ssize_t n = send(client->endpoint.fd, client->out + sent, client->out_size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && errno == EAGAIN)
+            break;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+
+    memmove(client->out, client->out + sent, client->out_size - sent);
+    client->out_size -= sent;
+    if (client->out_size < MAX_CLIENT_BACKLOG / 2)
+        pause_output(client, false);
+    update_client_events(client);
+    return true;
+}
+
+static void send_frame(Client *client, uint32_t tag, char type, const char *payload, size_t size)
+{
+    if (client->hung_up)
+        return;
+    if (client->out_size + FRAME_HEADER_SIZE + size > client->out_capacity)
+    {
+        size_t capacity = client->out_capacity ? client->out_capacity : OUTPUT_CHUNK;
+        while (client->out_size + FRAME_HEADER_SIZE + size > capacity)
+            capacity *= 2;
+        char *out = (char *)realloc(client->out, capacity);
+        if (out == NULL)
+        {
+            perror("-shellman: server: realloc");
+            return;
+        }
+        client->out = out;
+        client->out_capacity = capacity;
+    }
+
+    uint32_t header[2] = {htonl((uint32_t)size), htonl(tag)};
+    char *frame = client->out + client->out_size;
+    memcpy(frame, header, sizeof(header));
+    frame[8] = type;
+    memcpy(frame + FRAME_HEADER_SIZE, payload, size);
+    client->out_size += FRAME_HEADER_SIZE + size;
+
+    if (client->out_size > MAX_CLIENT_BACKLOG)
+        pause_output(client, true);
+}
+
+static void send_text(Client *client, uint32_t tag, char type, const char *text)
+{
+    send_frame(client, tag, type, text, strlen(text));
+}
+
+/* requests */
+
+static Request *find_request(Client *client, uint32_t tag)
+{
+    for (Request *request = client->requests; request != NULL; request = request->next)
+    {
+        if (request->tag == tag)
+            return request;
+    }
+    return NULL;
+}
+
+static void close_output(Request *request)
+{
+    if (request->output.fd == -1)
+        return;
+    if (request->client != NULL && !request->client->output_paused)
+        watch_output(request, false);
+    close(request->output.fd);
+    request->output.fd = -1;
+}
+
+// Send the exit of a request whose job is over and whose output is drained, and forget it.
+static void finish_request(Request *request)
+{
+    Client *client = request->client;
+    if (client == NULL)
+    {
+        free(request);
+        return;
+    }
+
+    Request **link = &client->requests;
+    while (*link != request)
+        link = &(*link)->next;
+    *link = request->next;
+
+    send_text(client, request->tag, FRAME_EXIT, request->exit_report);
+    free(request);
+    if (!flush_client(client) || (client->input_closed && client->requests == NULL && client->out_size == 0))
+        drop_client(client); // only marks it: the caller may still be reading its frames
+}
+
+static void format_exit(char *report, size_t size, const Job *job, int status)
+{
+    snprintf(report, size, "status=%d state=%s real=%.6f user=%.6f sys=%.6f maxrss=%ld nvcsw=%ld nivcsw=%ld",
+             status, job->job_state == Killed ? "Killed" : "Done", wall_seconds(&job->usage),
+             job->usage.utime.tv_sec + job->usage.utime.tv_usec / 1e6,
+             job->usage.stime.tv_sec + job->usage.stime.tv_usec / 1e6, job->usage.maxrss, job->usage.nvcsw,
+             job->usage.nivcsw);
+}
+
+static void release_clients()
+{
+    if (depth > 0)
+        return;
+
+    while (closing_clients != NULL)
+    {
+        Client *client = closing_clients;
+        closing_clients = client->next_closing;
+        free(client->in);
+        free(client->out);
+        free(client);
+    }
+}
+
+void request_done(Job *job)
+{
+    Request *request = job->request;
+
+    depth++;
+    format_exit(request->exit_report, sizeof(request->exit_report), job, exit_status(job));
+    request->job = NULL; // freed with the finished jobs
+    job->request = NULL;
+    if (request->output.fd == -1 && !request->held)
+        finish_request(request);
+    depth--;
+    release_clients();
+}
+
+static void read_output(Request *request)
+{
+    char buf[OUTPUT_CHUNK];
+    ssize_t n = read(request->output.fd, buf, sizeof(buf));
+
+    if (n == -1 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (n > 0)
+    {
+        send_frame(request->client, request->tag, FRAME_OUTPUT, buf, n);
+        if (!flush_client(request->client))
+            drop_client(request->client);
+        return;
+    }
+
+    close_output(request); // EOF: every stage writing there has exited
+    if (request->job == NULL && !request->held)
+        finish_request(request);
+}
+
+// LineReader for here-documents: the next line of the run request.
+static ssize_t next_request_line(const char **line)
+{
+    if (body_cur >= body_end)
+        return -1;
+
+    const char *newline = memchr(body_cur, '\n', body_end - body_cur);
+    size_t line_len = (newline != NULL ? newline : body_end) - body_cur;
+    *line = body_cur;
+    body_cur += line_len + 1;
+    return line_len;
+}
+
+static bool capture_output(Job *job, Request *request);
+
+static Request *new_request(Client *client, uint32_t tag, Job *job, bool capture)
+{
+    Request *request = (Request *)calloc(1, sizeof(Request));
+    if (request == NULL)
+        return NULL;
+    request->output.kind = OUTPUT;
+    request->output.fd = -1;
+    request->client = client;
+    request->tag = tag;
+    request->job = job;
+    request->next = client->requests;
+    client->requests = request;
+
+    if (capture && !capture_output(job, request))
+        perror("-shellman: server: pipe"); // runs uncaptured
+    job->request = request;
+    return request;
+}
+
+static void send_started(Client *client, uint32_t tag, const Job *job)
+{
+    char started[64];
+    if (job->job_state == Pending)
+        snprintf(started, sizeof(started), "job %d pending", job->id);
+    else
+        snprintf(started, sizeof(started), "job %d pgid %d", job->id, job->pgid);
+    send_text(client, tag, FRAME_STARTED, started);
+}
+
+void adopt_job(Job *job)
+{
+    if (builtin_client == NULL || adopted != NULL)
+        return; // not launched by the builtin of a request, or not its first job: runs on its own
+    if ((adopted = new_request(builtin_client, builtin_tag, job, builtin_capture)) != NULL)
+        adopted->held = true;
+}
+
+// Run a builtin inside the daemon, what it prints going back to the client if captured. A job it
+// launches (launch_job()) runs in the background and answers the request in its place.
+static void run_builtin(Client *client, uint32_t tag, Job *job, bool capture)
+{
+    int capture_fd = capture ? memfd_create("builtin-output", MFD_CLOEXEC) : -1;
+    int saved_stdout = -1;
+
+    fflush(stdout);
+    if (capture_fd != -1 && (saved_stdout = dup(STDOUT_FILENO)) != -1)
+        dup2(capture_fd, STDOUT_FILENO);
+
+    builtin_client = client;
+    builtin_tag = tag;
+    builtin_capture = capture;
+    run_job(job);
+    insert_finished_job(job); // a builtin job is done once run_job() returns
+    builtin_client = NULL;
+    Request *request = adopted;
+    adopted = NULL;
+
+    fflush(stdout);
+    if (saved_stdout != -1)
+    {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+
+    if (request != NULL && request->job != NULL)
+        send_started(client, tag, request->job);
+    if (capture_fd != -1)
+    {
+        char buf[OUTPUT_CHUNK];
+        ssize_t n;
+        lseek(capture_fd, 0, SEEK_SET);
+        while ((n = read(capture_fd, buf, sizeof(buf))) > 0)
+            send_frame(client, tag, FRAME_OUTPUT, buf, n);
+        close(capture_fd);
+    }
+
+    if (request != NULL)
+    {
+        request->held = false;
+        if (request->job == NULL && request->output.fd == -1)
+            finish_request(request); // over already, e.g. nothing could be launched
+        return;
+    }
+
+    char report[256];
+    format_exit(report, sizeof(report), job, 0);
+    send_text(client, tag, FRAME_EXIT, report);
+}
+
+// Point the stdout of the last stage into a pipe the daemon reads. Return false on error.
+static bool capture_output(Job *job, Request *request)
+{
+    Process *last = job->process_queue;
+    while (last->next != NULL)
+        last = last->next;
+    if (last->write_filepath != NULL)
+        return true; // goes to its file
+
+    int pipe_fd[2];
+    if (pipe2(pipe_fd, O_CLOEXEC) == -1)
+        return false;
+    fcntl(pipe_fd[0], F_SETFL, O_NONBLOCK);
+
+    last->write_fd = pipe_fd[1]; // run_job() closes it once the stage is launched, or skipped
+    request->output.fd = pipe_fd[0];
+    if (!request->client->output_paused)
+        watch_output(request, true);
+    return true;
+}
+
+static void start_request(Client *client, uint32_t tag, const char *payload, size_t size)
+{
+    if (size < 1)
+    {
+        send_text(client, tag, FRAME_ERROR, "empty request");
+        return;
+    }
+    if (find_request(client, tag) != NULL)
+    {
+        send_text(client, tag, FRAME_ERROR, "tag in use");
+        return;
+    }
+
+    const char *line = payload + 1, *end = payload + size;
+    const char *newline = memchr(line, '\n', end - line);
+    size_t line_len = (newline != NULL ? newline : end) - line;
+    bool capture = payload[0] & RUN_CAPTURE, has_command;
+
+    new_path_generation(); // a request is a line
+    Job *job = parse_string(line, line_len, &has_command);
+    reset_arena(shell->line_arena);
+    if (job == NULL)
+    {
+        send_text(client, tag, FRAME_ERROR, has_command ? "syntax error" : "no command");
+        return;
+    }
+
+    body_cur = newline != NULL ? newline + 1 : end;
+    body_end = end;
+    bool bodies_read = read_here_documents(job, next_request_line);
+    body_cur = body_end = NULL;
+    if (!bodies_read)
+    {
+        free_job(job);
+        send_text(client, tag, FRAME_ERROR, "here-document: out of memory");
+        return;
+    }
+
+    if (job->job_mode == BUILTIN_MODE)
+    {
+        run_builtin(client, tag, job, capture);
+        return;
+    }
+
+    if (new_request(client, tag, job, capture) == NULL)
+    {
+        free_job(job);
+        send_text(client, tag, FRAME_ERROR, "out of memory");
+        return;
+    }
+
+    job->job_mode = BACK_MODE; // the loop never waits for a job
+    insert_job(job);
+    if (queue_job(job))
+    {
+        send_started(client, tag, job);
+        return;
+    }
+
+    run_job(job);
+    if (job->running_procs == 0) // nothing could be launched
+    {
+        finish_job(job); // and its request with it
+        return;
+    }
+    set_job_state(job, Running);
+    send_started(client, tag, job);
+}
+
+static void signal_request(Client *client, uint32_t tag, const char *payload, size_t size)
+{
+    char number[16] = {0};
+    memcpy(number, payload, size < sizeof(number) - 1 ? size : sizeof(number) - 1);
+    int sig = atoi(number);
+    Request *request = find_request(client, tag);
+
+    if (request == NULL || request->job == NULL)
+    {
+        send_text(client, tag, FRAME_ERROR, "signal: no such job");
+        return;
+    }
+
+    Job *job = request->job;
+    if (job->job_state == Pending)
+    {
+        if (sig != SIGINT && sig != SIGHUP && sig != SIGTERM && sig != SIGKILL)
+        {
+            send_text(client, tag, FRAME_ERROR, "signal: job not started");
+            return;
+        }
+        dequeue_job(job);
+        set_job_state(job, Killed);
+        finish_job(job); // and its request with it
+        return;
+    }
+
+    if (kill(-job->pgid, sig) == -1)
+        send_text(client, tag, FRAME_ERROR, strerror(errno));
+}
+
+/* clients */
+
+static void handle_frames(Client *client)
+{
+    size_t used = 0;
+
+    while (!client->closing && client->in_size - used >= FRAME_HEADER_SIZE)
+    {
+        uint32_t header[2];
+        memcpy(header, client->in + used, sizeof(header));
+        uint32_t size = ntohl(header[0]), tag = ntohl(header[1]);
+        char type = client->in[used + 8];
+
+        if (client->in_size - used < FRAME_HEADER_SIZE + size)
+            break; // the rest has not arrived yet
+
+        const char *payload = client->in + used + FRAME_HEADER_SIZE;
+        if (type == FRAME_RUN)
+            start_request(client, tag, payload, size);
+        else if (type == FRAME_SIGNAL)
+            signal_request(client, tag, payload, size);
+        else
+            send_text(client, tag, FRAME_ERROR, "unknown request");
+        used += FRAME_HEADER_SIZE + size;
+    }
+
+    memmove(client->in, client->in + used, client->in_size - used);
+    client->in_size -= used;
+}
+
+// Read what the client sent and start its requests. Return false once there is nothing more to read now.
+static bool read_client(Client *client)
+{
+    if (client->in_size >= FRAME_HEADER_SIZE)
+    {
+        uint32_t size;
+        memcpy(&size, client->in, sizeof(size));
+        if (ntohl(size) > MAX_FRAME_SIZE)
+        {
+            printf("-shellman: server: frame of %u bytes: dropping the client\n", ntohl(size));
+            drop_client(client);
+            return false;
+        }
+    }
+
+    if (client->in_size == client->in_capacity)
+    {
+        size_t capacity = client->in_capacity ? client->in_capacity * 2 : OUTPUT_CHUNK;
+        char *in = (char *)realloc(client->in, capacity);
+        if (in == NULL)
+        {
+            drop_client(client);
+            return false;
+        }
+        client->in = in;
+        client->in_capacity = capacity;
+    }
+
+    ssize_t n = read(client->endpoint.fd, client->in + client->in_size, client->in_capacity - client->in_size);
+    if (n == -1 && (errno == EINTR || errno == EAGAIN))
+        return false;
+    if (n <= 0)
+    {
+        client->input_closed = true; // it may still wait for its responses
+        if (client->requests == NULL && client->out_size == 0)
+            drop_client(client);
+        else
+            update_client_events(client);
+        return false;
+    }
+
+    client->in_size += n;
+    handle_frames(client);
+    if (!client->closing && !flush_client(client))
+        drop_client(client);
+    return !client->closing;
+}
+
+static void accept_clients()
+{
+    int fd;
+
+    while ((fd = accept4(listener.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        Client *client = (Client *)calloc(1, sizeof(Client));
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = client;
+        if (client == NULL || epoll_ctl(server_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            close(fd);
+            free(client);
+            continue;
+        }
+        client->endpoint.kind = CLIENT;
+        client->endpoint.fd = fd;
+    }
+}
+
+// The client broke the protocol or its socket failed: hang up on its jobs, as a closed terminal
+// does, and forget its requests.
+// It is freed by release_clients(), not here: a caller up the stack may still hold it.
+static void drop_client(Client *client)
+{
+    Request *request = client->requests, *next;
+
+    if (client->closing)
+        return;
+    client->closing = true;
+    client->requests = NULL;
+
+    for (; request != NULL; request = next)
+    {
+        next = request->next;
+        close_output(request);
+        request->client = NULL;
+
+        Job *job = request->job;
+        if (job == NULL)
+        {
+            free(request); // over, but its output was not drained
+        }
+        else if (job->job_state == Pending)
+        {
+            dequeue_job(job);
+            set_job_state(job, Killed);
+            finish_job(job); // frees the orphaned request
+        }
+        else
+        {
+            kill(-job->pgid, SIGHUP);
+            kill(-job->pgid, SIGCONT); // a stopped job has to run to die of it
+        }
+    }
+
+    close(client->endpoint.fd); // also takes it out of the epoll instance
+    client->next_closing = closing_clients;
+    closing_clients = client;
+}
+
+// The client went away, maybe with requests still unread in its socket: start them all, and let
+// them run to the end. The client is dropped once they are answered, into the void.
+static void hang_up(Client *client)
+{
+    client->hung_up = true;
+    client->out_size = 0;
+    epoll_ctl(server_fd, EPOLL_CTL_DEL, client->endpoint.fd, NULL);
+
+    while (!client->input_closed && read_client(client))
+        ;
+    if (client->closing || client->input_closed)
+        return;
+
+    client->input_closed = true; // a read error: nothing more will come
+    if (client->requests == NULL)
+        drop_client(client);
+}
+
+/* event loop */
+
+static void server_ready()
+{
+    struct epoll_event event;
+
+    depth++;
+    // One at a time: handling an event may drop a client, and with it the endpoints of later events.
+    for (int i = 0; i < MAX_EVENTS && epoll_wait(server_fd, &event, 1, 0) == 1; i++)
+    {
+        Endpoint *endpoint = (Endpoint *)event.data.ptr;
+
+        if (endpoint->kind == LISTENER)
+        {
+            accept_clients();
+        }
+        else if (endpoint->kind == OUTPUT)
+        {
+            // the offset of output in Request is 0
+            read_output((Request *)endpoint);
+        }
+        else
+        {
+            Client *client = (Client *)endpoint;
+            if (event.events & (EPOLLERR | EPOLLHUP))
+                hang_up(client);
+            else if ((event.events & EPOLLOUT) && !flush_client(client))
+                drop_client(client);
+            else if (event.events & EPOLLIN)
+                read_client(client);
+        }
+    }
+    depth--;
+    release_clients();
+}
+
+static int open_socket(const char *socket_path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        printf("-shellman: server: socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        perror("-shellman: server: socket");
+        return -1;
+    }
+
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (bound == -1 && errno == EADDRINUSE)
+    {
+        // A socket file nobody listens on is left over from a daemon that died: take its place.
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool stale = probe != -1 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == -1 &&
+                     errno == ECONNREFUSED;
+        if (probe != -1)
+            close(probe);
+        if (!stale)
+        {
+            printf("-shellman: server: %s is in use\n", socket_path);
+            close(fd);
+            return -1;
+        }
+        unlink(socket_path);
+        bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    if (bound == -1)
+    {
+        perror("-shellman: server: bind");
+        close(fd);
+        return -1;
+    }
+
+    chmod(socket_path, S_IRUSR | S_IWUSR); // commands run as this user: nobody else may send them
+    if (listen(fd, SERVER_BACKLOG) == -1)
+    {
+        perror("-shellman: server: listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_server(const char *socket_path)
+{
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd != -1)
+    {
+        dup2(null_fd, STDIN_FILENO); // what the jobs read unless redirected
+        close(null_fd);
+    }
+
+    shell->serving = true; // a builtin may not wait for what it launches
+    if (init_events(false) == -1)
+        return -1;
+    if ((server_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    {
+        perror("-shellman: server: epoll_create1");
+        return -1;
+    }
+    if ((listener.fd = open_socket(socket_path)) == -1)
+        return -1;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listener;
+    if (epoll_ctl(server_fd, EPOLL_CTL_ADD, listener.fd, &ev) == -1 || watch_events(server_fd, server_ready) == -1)
+    {
+        perror("-shellman: server: epoll_ctl");
+        return -1;
+    }
+
+    printf("-shellman: serving on %s (pid %d)\n", socket_path, getpid());
+    fflush(stdout);
+    run_event_loop();
+    return -1;
+}
@@ -0,0 +1,87 @@
+#ifndef server_h
+#define server_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+
+#define SERVER_BACKLOG 64
+#define FRAME_HEADER_SIZE 9         // size (4), tag (4) and type (1)
+#define MAX_FRAME_SIZE (1 << 20)    // of the payload of a request
+#define MAX_CLIENT_BACKLOG (4 << 20) // unsent bytes past which the output of a client's jobs waits in their pipes
+#define OUTPUT_CHUNK 65536
+
+// request frames
+#define FRAME_RUN 'R'
+#define FRAME_SIGNAL 'K'
+// response frames
+#define FRAME_STARTED 'S'
+#define FRAME_OUTPUT 'O'
+#define FRAME_EXIT 'X'
+#define FRAME_ERROR 'E'
+
+#define RUN_CAPTURE 0x01 // flag of a run request: send the job's stdout back in FRAME_OUTPUT frames
+
+/**
+ *
+ * Daemon mode: `shellman -d SOCKET`.
+ *
+ * One long-lived shell listens on a UNIX stream socket (mode 0600; a stale
+ * socket file is replaced) and runs the command lines its clients send, each
+ * through the parse cache, parse() and run_job() like a typed line, as a
+ * background job with its own process group. The event loop of event.h reaps
+ * the jobs; the daemon's own epoll instance, nested into it, accepts clients
+ * and reads their requests and the output of their jobs, so one thread serves
+ * any number of clients and requests at once. Jobs read /dev/null unless
+ * redirected; notices and errors go to the daemon's stdout, i.e. its log.
+ *
+ * Every frame, either way, is a header and a payload:
+ *
+ *   uint32 size  of the payload, big-endian
+ *   uint32 tag   chosen by the client for each request, echoed in the responses
+ *   uint8  type
+ *
+ * Requests:
+ *
+ *   R  run: a flags byte (RUN_CAPTURE), then a command line; lines after the
+ *      first are the bodies of its here-documents
+ *   K  signal: the decimal number of a signal for the process group of the job
+ *      run by request tag (a pending job is dropped instead by SIGINT, SIGHUP,
+ *      SIGTERM or SIGKILL)
+ *
+ * Responses, in this order for a run request:
+ *
+ *   S  started: "job ID pgid PGID", or "job ID pending" while the admission
+ *      queue (admit.h) holds it
+ *   O  output: bytes of the stdout of the last stage, if captured
+ *   X  exit, the last frame of the request: "status=N state=Done|Killed
+ *      real=S user=S sys=S maxrss=KIB nvcsw=N nivcsw=N"
+ *   E  error, with a message: ends a run request that could not start; the
+ *      answer to a signal request that could not be delivered
+ *
+ * Builtins run inside the daemon at once; with RUN_CAPTURE, what they print
+ * comes back as output. Nothing waits in the daemon: a job launched by a
+ * builtin (admit, place, pipes) runs in the background and answers the request
+ * as if it had been sent alone, after what the builtin printed; parallel and
+ * xargs run as background pools, and bench is refused. A client may shut down
+ * its writing side and still receive the responses to the requests it sent. One
+ * that hangs up has its requests, those still unread in its socket included,
+ * run to the end and their responses discarded; one that breaks the protocol,
+ * or whose socket fails while a response is sent, has its jobs sent SIGHUP,
+ * like a terminal that goes away.
+ *
+**/
+
+// Serve on socket_path until a fatal error. Return -1 if the socket could not be set up.
+int run_server(const char *socket_path);
+// The job of a request is over: report its exit once its output is drained.
+void request_done(Job *job);
+// Make a job launched by the builtin of a request (launch_job()) answer that request. No-op outside one.
+void adopt_job(Job *job);
+
+#endif
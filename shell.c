@@ -0,0 +1,297 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "shell.h"
+
+// The rest of the script being run, where here-documents are read from; NULL when interactive.
+static const char *script_cur = NULL, *script_end = NULL;
+
+// LineReader for here-documents: the next line of the script, or of the terminal after a "> " prompt.
+static ssize_t next_body_line(const char **line)
+{
+    static const char prompt[] = "> ";
+
+    if (script_cur != NULL)
+    {
+        if (script_cur >= script_end)
+            return -1;
+
+        const char *newline = memchr(script_cur, '\n', script_end - script_cur);
+        size_t line_len = (newline != NULL ? newline : script_end) - script_cur;
+        *line = script_cur;
+        script_cur += line_len + 1;
+        return line_len;
+    }
+
+    if (shell->interactive)
+    {
+        if (line_editor_enabled())
+        {
+            begin_line(prompt);
+        }
+        else
+        {
+            printf("%s", prompt);
+            fflush(stdout);
+        }
+        wait_for_input(prompt);
+    }
+    return read_stdin_line(line);
+}
+
+// Parse a tokenized line into a new job. Return NULL if it does not parse (saying why, unless the line is empty).
+static Job *parse_tokens(Token *tokens, size_t line_size)
+{
+    if (tokens->label == NONE || line_size == 0) // empty line or tokenize error
+        return NULL;
+
+    Job *job = new_job(line_size);
+    if (job == NULL)
+    {
+        perror("-shellman: new_job");
+        return NULL;
+    }
+
+    uint64_t start = trace_clock();
+    int8_t parsed = parse(job, tokens);
+    trace_span("parse", start, job->line);
+
+    if (parsed == -1)
+    {
+        printf("-shellman: failed to parse tokens\n");
+        free_job(job);
+        return NULL;
+    }
+    return job;
+}
+
+// Launch a parsed job and (for a foreground job) wait for it. NULL does nothing but clean up.
+static void eval_job(Job *job)
+{
+    uint64_t start;
+
+    if (job != NULL && !read_here_documents(job, next_body_line))
+    {
+        perror("-shellman: here-document");
+        free_job(job);
+        job = NULL;
+    }
+
+    shell->cur_job = job;
+    if (job == NULL)
+        goto POSTPROCESSING;
+
+    // use job from here on: fg and bg replace shell->cur_job with the job they resume
+    if (job->job_mode != BUILTIN_MODE)
+    {
+        insert_job(job);
+        if (job->job_mode == BACK_MODE && queue_job(job))
+            goto POSTPROCESSING; // launched by admit_jobs() once the limits allow
+    }
+    run_job(job);
+    if (job->job_mode == BUILTIN_MODE)
+    {
+        insert_finished_job(job); // a builtin job is done once run_job() returns
+        if (shell->interactive)
+            record_history(job);
+    }
+
+    switch (shell->cur_job->job_mode)
+    {
+    case BACK_MODE:
+        goto BACKGROUND;
+        break;
+
+    case FORE_MODE:
+        goto FOREGROUND;
+        break;
+
+    default:
+        goto POSTPROCESSING;
+    }
+
+FOREGROUND:
+    // To prevent SIGTTIN, tcsetpgrp() for setting current job's pgrp to foreground process is called in run_job()
+    set_job_state(shell->cur_job, Running);
+
+    start = trace_clock();
+    wait_fore_job(shell->cur_job);
+    trace_span("wait_fore_job", start, shell->cur_job->line);
+
+    if (shell->interactive && tcsetpgrp(STDIN_FILENO, getpgid((pid_t)0)) == -1)
+    {
+        perror("tcsetpgrp");
+    }
+    goto POSTPROCESSING;
+
+BACKGROUND:
+    if (shell->cur_job->running_procs == 0) // none of its processes could be launched
+    {
+        finish_job(shell->cur_job);
+        goto POSTPROCESSING;
+    }
+
+    set_job_state(shell->cur_job, Running);
+    printf("[%d] %d %s\n", shell->cur_job->id, shell->cur_job->pgid, shell->cur_job->line);
+    goto POSTPROCESSING;
+
+POSTPROCESSING:
+    start = trace_clock();
+    free_jobs(); // free jobs and finished_job_list
+    trace_span("free_jobs", start, NULL);
+}
+
+void eval_line(Token *tokens, size_t line_size)
+{
+    new_path_generation();
+    wait_back_job();
+    admit_jobs();
+    eval_job(parse_tokens(tokens, line_size));
+}
+
+Job *parse_string(const char *line, size_t line_len, bool *has_command)
+{
+    uint64_t start = trace_clock();
+    Job *job = cached_job(line, line_len);
+    if (job != NULL)
+    {
+        trace_span("copy_job", start, job->line);
+        *has_command = true;
+        return job;
+    }
+
+    Token *tokens = new_token(shell->line_arena, NULL);
+    size_t line_size = tokenize_string(shell->line_arena, tokens, line, line_len);
+    trace_span("tokenize", start, NULL);
+
+    *has_command = tokens->label != NONE;
+    if ((job = parse_tokens(tokens, line_size)) != NULL)
+        cache_job(line, line_len, job); // before it runs and its processes fill in
+    return job;
+}
+
+bool eval_string(const char *line, size_t line_len)
+{
+    bool has_command;
+
+    new_path_generation();
+    wait_back_job();
+    admit_jobs();
+    eval_job(parse_string(line, line_len, &has_command));
+    return has_command;
+}
+
+long run_script(const char *script, size_t script_size)
+{
+    long n_commands = 0;
+    struct timespec start, finish;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    script_cur = script;
+    script_end = script + script_size;
+    while (script_cur < script_end)
+    {
+        const char *line = script_cur;
+        const char *newline = memchr(line, '\n', script_end - line);
+        size_t line_len = (newline != NULL ? newline : script_end) - line;
+
+        script_cur += line_len + 1; // before evaluating: the line's here-documents follow it
+        if (line_len > 0 && line[0] != '#') // skip blank lines, comments and shebang
+        {
+            if (eval_string(line, line_len))
+                n_commands++;
+            reset_arena(shell->line_arena);
+        }
+    }
+    script_cur = script_end = NULL;
+    drain_admission_queue(); // the queued jobs were submitted too
+
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+    double elapsed = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+    fflush(stdout);
+    fprintf(stderr, "-shellman: %ld commands in %.3f s (%.1f commands/s)\n",
+            n_commands, elapsed, elapsed > 0 ? n_commands / elapsed : 0.0);
+
+    return n_commands;
+}
+
+long run_script_file(const char *filepath)
+{
+    int fd;
+    struct stat st;
+
+    if ((fd = open(filepath, O_RDONLY)) == -1)
+    {
+        perror("-shellman: open");
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1)
+    {
+        perror("-shellman: fstat");
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return run_script("", 0);
+    }
+
+    char *script = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (script == MAP_FAILED)
+    {
+        perror("-shellman: mmap");
+        return -1;
+    }
+    madvise(script, st.st_size, MADV_SEQUENTIAL);
+
+    long n_commands = run_script(script, st.st_size);
+
+    munmap(script, st.st_size);
+    return n_commands;
+}
+
+void run_interactive()
+{
+    static const char prompt[] = "shellman$ ";
+
+    shell->interactive = true;
+    init_history();
+    init_line_editor();
+    if (init_events(true) == -1)
+        printf("-shellman: background jobs are reaped only before each prompt\n");
+
+    while (1)
+    {
+        const char *line;
+        ssize_t line_len;
+
+        if (line_editor_enabled())
+        {
+            begin_line(prompt);
+        }
+        else
+        {
+            printf("%s", prompt);
+            fflush(stdout);
+        }
+        flush_trace(); // nothing else to do until a line is typed
+
+        uint64_t start = trace_clock();
+        wait_for_input(prompt);
+        trace_span("wait_input", start, NULL);
+
+        line_len = read_command_line(&line);
+        eval_string(line, line_len);
+
+        reset_arena(shell->line_arena);
+        printf("\n");
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef shell_h
+#define shell_h
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "job.h"
+#include "admit.h"
+#include "heredoc.h"
+#include "history.h"
+#include "lineedit.h"
+#include "parser.h"
+#include "parsecache.h"
+#include "trace.h"
+
+// Parse, launch and (for foreground jobs) wait for one tokenized command line.
+void eval_line(Token *tokens, size_t line_size);
+// New job from a raw line, through the parse cache; its tokens are left in shell->line_arena.
+// Return NULL if the line holds no command or does not parse (*has_command tells which).
+Job *parse_string(const char *line, size_t line_len, bool *has_command);
+// eval_line() of a raw line, parsed through the parse cache. Return false if the line holds no command.
+bool eval_string(const char *line, size_t line_len);
+
+// Non-interactive mode: run every line of a script held in memory.
+// Return the number of executed commands, or -1 on error.
+long run_script(const char *script, size_t script_size);
+long run_script_file(const char *filepath);
+
+// Interactive mode: prompt, read and evaluate lines until EOF on stdin.
+void run_interactive();
+
+#endif
@@ -0,0 +1,207 @@
+#include <signal.h>
+
+#include "spawn.h"
+#include "job.h"
+#include "pipemon.h"
+#include "place.h"
+#include "stats.h"
+
+extern char **environ;
+
+static SpawnMode spawn_mode = SPAWN_FORK;
+static bool spawn_mode_loaded = false;
+
+static const char *spawn_mode_names[] = {
+    "fork", "posix_spawn", "forkserver"};
+
+bool set_spawn_mode(const char *name)
+{
+    for (size_t i = 0; i < sizeof(spawn_mode_names) / sizeof(char *); i++)
+    {
+        if (strcmp(name, spawn_mode_names[i]) == 0)
+        {
+            if (i == SPAWN_FORK_SERVER && !start_fork_server()) // while the shell is still small
+                return false;
+            spawn_mode = (SpawnMode)i;
+            spawn_mode_loaded = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static SpawnMode get_spawn_mode()
+{
+    if (!spawn_mode_loaded)
+    {
+        char *name = getenv("SHELLMAN_SPAWN");
+        if (name != NULL && !set_spawn_mode(name))
+            printf("-shellman: SHELLMAN_SPAWN: unknown backend: %s\n", name);
+        spawn_mode_loaded = true;
+    }
+    return spawn_mode;
+}
+
+const char *spawn_mode_name()
+{
+    return spawn_mode_names[get_spawn_mode()];
+}
+
+static pid_t spawn_fork(Process *process, const char *path, pid_t pgid)
+{
+    uint64_t start = trace_clock();
+    pid_t pid = fork();
+
+    if (pid == -1)
+    {
+        perror("-shellman: fork");
+        return -1;
+    }
+    else if (pid > 0)
+    {
+        return pid;
+    }
+
+    set_default();
+    if (process->job != NULL && process->job->placement != NULL)
+        apply_placement(process); // before exec, so the command never runs anywhere else
+
+    // setpgid() is called on both sides of fork() so that the group exists whichever runs first.
+    setpgid(0, pgid);
+
+    if (process->read_fd)
+    {
+        if (dup2(process->read_fd, STDIN_FILENO) == -1)
+        {
+            perror("-shellman: dup2\n");
+            _exit(1);
+        }
+        if (close(process->read_fd) == -1)
+        {
+            perror("-shellman: close\n");
+            _exit(1);
+        }
+    }
+
+    if (process->write_fd)
+    {
+        if (dup2(process->write_fd, STDOUT_FILENO) == -1)
+        {
+            perror("-shellman: dup2\n");
+            _exit(1);
+        }
+        if (close(process->write_fd) == -1)
+        {
+            perror("-shellman: close\n");
+            _exit(1);
+        }
+    }
+
+    if (process->next != NULL && process->next->read_fd)
+        close(process->next->read_fd); // read end of our own output pipe
+
+    if (is_stage_builtin(process->cmd))
+    {
+        if (process->job != NULL)
+            close_relay_ends(process->job); // or the edges of the job would never see EOF
+        _exit(copy(process->args + 1));
+    }
+
+    trace_child_span("exec", start, process->cmd); // from fork() to execv() in the child
+
+    if (execv(path, process->args) == -1)
+    {
+        perror("-shellman: exec");
+        count_exec_failure();
+        _exit(1); // Exited with error; _exit() so that stdio buffers copied from the shell are not flushed twice
+    }
+    _exit(0);
+}
+
+static pid_t spawn_posix(Process *process, const char *path, pid_t pgid)
+{
+    pid_t pid;
+    int err;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t default_signals, mask;
+    short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+
+    posix_spawn_file_actions_init(&actions);
+    if (process->read_fd)
+    {
+        posix_spawn_file_actions_adddup2(&actions, process->read_fd, STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, process->read_fd);
+    }
+    if (process->write_fd)
+    {
+        posix_spawn_file_actions_adddup2(&actions, process->write_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, process->write_fd);
+    }
+    if (process->next != NULL && process->next->read_fd)
+        posix_spawn_file_actions_addclose(&actions, process->next->read_fd);
+
+    // Same signal setup as set_default() in the fork path.
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGTTOU);
+    sigaddset(&default_signals, SIGTTIN);
+    sigaddset(&default_signals, SIGTSTP);
+    sigemptyset(&mask);
+
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setsigdefault(&attr, &default_signals);
+    posix_spawnattr_setsigmask(&attr, &mask);
+
+    err = posix_spawn(&pid, path, &actions, &attr, process->args, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err != 0)
+    {
+        printf("-shellman: posix_spawn: %s: %s\n", path, strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+pid_t spawn_process(Process *process, const char *path, pid_t pgid)
+{
+    // no executable to exec, or a placement to apply in the child: see place.h
+    if (is_stage_builtin(process->cmd) || (process->job != NULL && process->job->placement != NULL))
+        return spawn_fork(process, path, pgid);
+
+    switch (get_spawn_mode())
+    {
+    case SPAWN_POSIX:
+        return spawn_posix(process, path, pgid);
+
+    case SPAWN_FORK_SERVER:
+        if (!fork_server_accepts(process, path))
+            return spawn_fork(process, path, pgid); // e.g. a batch of xargs
+        return fork_server_spawn(process, path, pgid);
+
+    default:
+        return spawn_fork(process, path, pgid);
+    }
+}
+
+/* builtin command */
+
+void spawn(char **args)
+{
+    if (args[0] == NULL)
+    {
+        printf("%s\n", spawn_mode_name());
+        return;
+    }
+
+    if (!set_spawn_mode(args[0]))
+        printf("-shellman: spawn example usage: `spawn fork`, `spawn posix_spawn` or `spawn forkserver`\n");
+}
@@ -0,0 +1,48 @@
+#ifndef spawn_h
+#define spawn_h
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "copy.h"
+#include "forkserver.h"
+#include "process.h"
+#include "trace.h"
+#include "util.h"
+
+/**
+ *
+ * Backends launching one process of a pipeline:
+ *
+ * SPAWN_FORK:  fork(), then redirect and execv() in the child.
+ * SPAWN_POSIX: posix_spawn() with file actions for the redirects. glibc implements it
+ *              with clone(CLONE_VM | CLONE_VFORK), so no page tables are copied and
+ *              the launch cost does not grow with the RSS of the shell.
+ * SPAWN_FORK_SERVER: a request to the fork server (forkserver.h), a small helper which
+ *              forks on behalf of the shell; the shell itself never forks.
+ *
+ * The backend is chosen by $SHELLMAN_SPAWN at startup or by the `spawn` builtin.
+ * Stage builtins (`copy`) have no executable to exec and always use fork().
+ *
+**/
+typedef enum spawnmode
+{
+    SPAWN_FORK,
+    SPAWN_POSIX,
+    SPAWN_FORK_SERVER
+} SpawnMode;
+
+// Launch process into process group pgid (0: a new group led by the process itself).
+// Return the pid, or -1 if nothing was launched.
+pid_t spawn_process(Process *process, const char *path, pid_t pgid);
+bool set_spawn_mode(const char *name);
+const char *spawn_mode_name();
+
+void spawn(char **args);
+
+#endif
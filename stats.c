@@ -0,0 +1,218 @@
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "stats.h"
+#include "job.h"
+
+static ShellStats private_stats; // until, or unless, the page is mapped
+static ShellStats *stats = &private_stats;
+static size_t page_size = 0; // of the mapping, 0 if none
+static char stats_filepath[256];
+static pid_t owner_pid;
+
+static uint64_t realtime_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Every update by the shell is framed by these two: a reader that sees seq change or odd copies again.
+static void begin_update()
+{
+    __atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_update()
+{
+    __atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void remove_stats()
+{
+    if (getpid() != owner_pid)
+        return; // a child which exit()ed instead of _exit()
+
+    unlink(stats_filepath);
+    munmap(stats, page_size);
+    stats = &private_stats;
+    page_size = 0;
+}
+
+void init_stats()
+{
+    const char *dir = getenv("SHELLMAN_STATS");
+
+    private_stats.magic = STATS_MAGIC;
+    private_stats.version = STATS_VERSION;
+    private_stats.size = sizeof(ShellStats);
+    private_stats.pid = getpid();
+    private_stats.started_ns = realtime_ns();
+
+    if (dir == NULL)
+        dir = STATS_DIR;
+    if (dir[0] == '\0' || strcmp(dir, "off") == 0)
+        return;
+
+    snprintf(stats_filepath, sizeof(stats_filepath), STATS_FILE_FORMAT, dir, getpid());
+    int fd = open(stats_filepath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        perror("-shellman: SHELLMAN_STATS");
+        return;
+    }
+
+    size_t size = (sysconf(_SC_PAGESIZE) + sizeof(ShellStats) - 1) / sysconf(_SC_PAGESIZE) * sysconf(_SC_PAGESIZE);
+    ShellStats *page = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        page = (ShellStats *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED)
+    {
+        perror("-shellman: SHELLMAN_STATS");
+        unlink(stats_filepath);
+        return;
+    }
+
+    *page = private_stats; // seq 0: readable from here on
+    stats = page;
+    page_size = size;
+    owner_pid = getpid();
+    atexit(remove_stats);
+}
+
+static void sample_memory(uint64_t now_ns)
+{
+    struct mallinfo2 heap = mallinfo2();
+
+    begin_update();
+    stats->arena_bytes = arena_bytes();
+    stats->heap_bytes = heap.uordblks + heap.hblkhd; // large chunks are mmapped by malloc()
+    stats->updated_ns = now_ns;
+    end_update();
+}
+
+void publish_stats()
+{
+    static uint64_t sampled_ns = 0;
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &now); // no syscall: this runs after every line
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    if (now_ns < sampled_ns + STATS_SAMPLE_INTERVAL_NS)
+        return;
+
+    sampled_ns = now_ns;
+    sample_memory(now_ns);
+}
+
+void count_job_state(int from, int to)
+{
+    begin_update();
+    if (from >= 0)
+        stats->jobs[from]--;
+    if (to >= 0)
+        stats->jobs[to]++;
+    end_update();
+}
+
+void count_command()
+{
+    begin_update();
+    stats->commands++;
+    end_update();
+}
+
+void count_spawn(uint64_t ns, pid_t pid)
+{
+    size_t bucket = 0;
+    while (bucket < SPAWN_BUCKETS - 1 && ns >= (1000ULL << bucket))
+        bucket++;
+
+    begin_update();
+    if (pid == -1)
+    {
+        stats->fork_failures++;
+    }
+    else
+    {
+        stats->forks++;
+        stats->spawn_latency[bucket]++;
+        stats->spawn_ns += ns;
+    }
+    end_update();
+}
+
+void count_exec_failure()
+{
+    __atomic_fetch_add(&stats->exec_failures, 1, __ATOMIC_RELAXED);
+}
+
+void count_reaped()
+{
+    begin_update();
+    stats->reaped++;
+    end_update();
+}
+
+void count_finished(bool killed)
+{
+    begin_update();
+    stats->jobs_done++;
+    stats->jobs_killed += killed;
+    end_update();
+}
+
+/* builtin command */
+
+static const char *state_names[N_JOB_STATES] = {"pending", "running", "stopped", "done", "killed"};
+
+void shellstat(char **args)
+{
+    ShellStats copy;
+
+    if (args[0] != NULL)
+    {
+        printf("-shellman: shellstat example usage: `shellstat`\n");
+        return;
+    }
+
+    sample_memory(realtime_ns());
+    if (!read_stats(stats, &copy))
+    {
+        printf("-shellman: shellstat: unreadable page\n");
+        return;
+    }
+
+    printf("page\t%s\n", page_size > 0 ? stats_filepath : "none (SHELLMAN_STATS=off)");
+    printf("pid %lld  up %.3fs\n", (long long)copy.pid, (copy.updated_ns - copy.started_ns) / 1e9);
+    printf("commands %llu  forks %llu  fork failures %llu  exec failures %llu  reaped %llu\n",
+           (unsigned long long)copy.commands, (unsigned long long)copy.forks, (unsigned long long)copy.fork_failures,
+           (unsigned long long)copy.exec_failures, (unsigned long long)copy.reaped);
+
+    printf("jobs");
+    for (int state = 0; state < N_JOB_STATES; state++)
+        printf("  %s %llu", state_names[state], (unsigned long long)copy.jobs[state]);
+    printf("  (finished %llu, killed %llu)\n", (unsigned long long)copy.jobs_done,
+           (unsigned long long)copy.jobs_killed);
+
+    printf("memory  arenas %llu  heap %llu bytes\n", (unsigned long long)copy.arena_bytes,
+           (unsigned long long)copy.heap_bytes);
+
+    printf("spawn latency");
+    if (copy.forks > 0)
+        printf(" (mean %.1fus)", copy.spawn_ns / 1e3 / copy.forks);
+    printf("\n");
+    for (int bucket = 0; bucket < SPAWN_BUCKETS; bucket++)
+    {
+        if (copy.spawn_latency[bucket] == 0)
+            continue;
+        if (bucket < SPAWN_BUCKETS - 1)
+            printf("  < %6lluus %llu\n", 1ULL << bucket, (unsigned long long)copy.spawn_latency[bucket]);
+        else
+            printf("  >= %5lluus %llu\n", 1ULL << (bucket - 1), (unsigned long long)copy.spawn_latency[bucket]);
+    }
+}
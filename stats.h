@@ -0,0 +1,105 @@
+#ifndef stats_h
+#define stats_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define STATS_MAGIC 0x3154415453534853ULL // "SHSSTAT1" in a little-endian file
+#define STATS_VERSION 1
+#define STATS_DIR "/dev/shm"
+#define STATS_FILE_FORMAT "%s/shellman.%d.stats" // directory, pid
+#define N_JOB_STATES 5                           // of JobState (job.h)
+#define SPAWN_BUCKETS 16
+#define STATS_SAMPLE_INTERVAL_NS 100000000 // between two samples of the memory by publish_stats()
+
+/**
+ *
+ * Live counters of the shell in a shared-memory page: `/dev/shm/shellman.PID.stats`.
+ *
+ * The file is a ShellStats mmapped MAP_SHARED. A monitor maps it read-only once
+ * and then samples it with plain loads: no syscall, no signal to the shell, no
+ * parsing. $SHELLMAN_STATS=DIR puts the file elsewhere and SHELLMAN_STATS=off
+ * turns it off. The shell removes the file at exit; one left behind by a shell
+ * that crashed has a pid nobody answers to. tools/shellstat reads every page of
+ * the directory; `shellstat` prints the shell's own.
+ *
+ * The shell is the only writer and wraps every update in a seqlock: seq is odd
+ * while it writes. read_stats() copies the page and retries until seq was the
+ * same even number before and after, so a copy is never torn. exec_failures is
+ * the exception: a forked child whose execv() fails adds to it atomically,
+ * outside the seqlock, since it has no other way to tell.
+ *
+ * Layout: magic, version and size first. Fields are only appended and the file
+ * is a whole page, so a reader built against an older layout reads a valid
+ * prefix; version changes if the meaning of an existing field does.
+ *
+ * Counters run from the start of the shell. jobs[] is how many jobs are in each
+ * JobState (Pending, Running, Stopped, Done, Killed), kept as the jobs change
+ * state; Done and Killed ones stay until freed, after their line. The memory
+ * fields are sampled when the shell publishes after a line or a turn of the
+ * event loop, but no more than every STATS_SAMPLE_INTERVAL_NS (mallinfo2() is
+ * not cheap), and whenever `shellstat` runs; updated_ns tells when that was.
+ *
+**/
+typedef struct shellstats
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t size; // sizeof(ShellStats) of the shell that writes
+    uint64_t seq;  // odd while the shell writes
+    int64_t pid;
+    uint64_t started_ns; // CLOCK_REALTIME
+    uint64_t updated_ns; // CLOCK_REALTIME of the last publish
+    uint64_t commands;   // jobs run, builtins included
+    uint64_t forks;      // processes launched, whatever the spawn backend
+    uint64_t fork_failures;        // no process launched: fork(), posix_spawn() or the fork server failed
+    uint64_t exec_failures;        // commands not found, and failed execv() in a forked child
+    uint64_t reaped;               // children that terminated
+    uint64_t jobs[N_JOB_STATES];   // by JobState
+    uint64_t jobs_done;            // ever finished
+    uint64_t jobs_killed;          // of which killed by a signal or dropped
+    uint64_t spawn_latency[SPAWN_BUCKETS]; // launches that took less than 2^i us; the last bucket takes the rest
+    uint64_t spawn_ns;                     // over all launches
+    uint64_t arena_bytes;                  // of arena chunks (arena.h)
+    uint64_t heap_bytes;                   // in use by malloc(), arena chunks included
+} ShellStats;
+
+// Consistent copy of a page, or false if it is not one (any more) or the shell kept writing.
+static inline bool read_stats(const volatile ShellStats *page, ShellStats *copy)
+{
+    for (int attempt = 0; attempt < 1000; attempt++)
+    {
+        uint64_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+
+        memcpy(copy, (const void *)page, sizeof(ShellStats));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+            return copy->magic == STATS_MAGIC && copy->version == STATS_VERSION;
+    }
+    return false;
+}
+
+// Publish the counters in shared memory unless $SHELLMAN_STATS says otherwise. The file is removed at exit.
+void init_stats();
+// Sample the memory and stamp the page, at most every STATS_SAMPLE_INTERVAL_NS.
+void publish_stats();
+
+// A job entered state to, or left state from, of JobState (job.h); -1 for none.
+void count_job_state(int from, int to);
+void count_command();
+// A launch that took ns; pid -1 if nothing was launched.
+void count_spawn(uint64_t ns, pid_t pid);
+// Safe in a forked child.
+void count_exec_failure();
+void count_reaped();
+void count_finished(bool killed);
+
+void shellstat(char **args);
+
+#endif
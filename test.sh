@@ -10,7 +10,7 @@ BACKGREEN='\033[102m'
 PASSEDCOUNTER=0
 TESTNUM=0
 
-program="/Users/keresu0720/environment/Sandbox-Class/shell-kadai/shellman"
+program="${SHELLMAN:-/Users/keresu0720/environment/Sandbox-Class/shell-kadai/shellman}"
 dir="./sample_programs"
 
 assert_exec() {
@@ -209,6 +209,324 @@ assert_rightredirectandleftredirect() {
         echo -e "${RED}assert_rightredirectandleftredirect() OK $input => $expected expected, but got $output ${NC}"
     fi
 }
+assert_server_halfclose() {
+    ((TESTNUM++))
+    expected="$1"
+
+    socket="/tmp/shellman-test-$$.sock"
+    ${program} -d "${socket}" > /dev/null 2>&1 &
+    daemon=$!
+    sleep 0.5
+
+    # Several requests in one write, then a half-close: every one of them must still be answered.
+    output=`timeout 10 python3 - "${socket}" <<'EOF'
+import socket, struct, sys
+lines = [b"\x01echo one", b"\x00nosuchcmd", b"\x00true", b"\x01jobs", b"\x00sleep 0.2"]
+# A client that cannot receive: answering its first request drops it while the others are still being read.
+deaf = socket.socket(socket.AF_UNIX)
+deaf.connect(sys.argv[1])
+deaf.shutdown(socket.SHUT_RD)
+deaf.sendall(b"".join(struct.pack(">II", 10, tag) + b"R" + b"\x00nosuchcmd" for tag in range(5)))
+deaf.close()
+client = socket.socket(socket.AF_UNIX)
+client.connect(sys.argv[1])
+client.sendall(b"".join(struct.pack(">II", len(line), tag + 1) + b"R" + line for tag, line in enumerate(lines)))
+client.shutdown(socket.SHUT_WR)
+data = b""
+while True:
+    chunk = client.recv(65536)
+    if not chunk:
+        break
+    data += chunk
+answered = []
+while len(data) >= 9:
+    size, tag = struct.unpack(">II", data[:8])
+    if data[8:9] in (b"X", b"E"):
+        answered.append(tag)
+    data = data[9 + size:]
+print(*sorted(answered))
+EOF`
+    kill -0 ${daemon} 2> /dev/null && alive="alive" || alive="dead"
+    kill ${daemon} 2> /dev/null
+    wait ${daemon} 2> /dev/null
+    rm -f "${socket}"
+
+    if [ "$output" = "$expected" ] && [ "$alive" = "alive" ]; then
+        echo
+        echo -e "${GREEN}assert_server_halfclose() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_server_halfclose() $expected expected, but got $output (daemon ${alive}) ${NC}"
+    fi
+}
+
+assert_server_builtins() {
+    ((TESTNUM++))
+    expected="$1"
+
+    socket="/tmp/shellman-test-$$.sock"
+    ${program} -d "${socket}" > /dev/null 2>&1 &
+    daemon=$!
+    sleep 0.5
+
+    # A job launched by a builtin must not hold up the requests behind it: the order the exits arrive in.
+    output=`timeout 10 python3 - "${socket}" <<'EOF'
+import socket, struct, sys
+lines = [b"\x00admit sleep 1", b"\x01jobs", b"\x00bench -n 1 true"]
+client = socket.socket(socket.AF_UNIX)
+client.connect(sys.argv[1])
+client.sendall(b"".join(struct.pack(">II", len(line), tag + 1) + b"R" + line for tag, line in enumerate(lines)))
+client.shutdown(socket.SHUT_WR)
+data = b""
+while True:
+    chunk = client.recv(65536)
+    if not chunk:
+        break
+    data += chunk
+answered = []
+while len(data) >= 9:
+    size, tag = struct.unpack(">II", data[:8])
+    if data[8:9] in (b"X", b"E"):
+        answered.append(tag)
+    data = data[9 + size:]
+print(*answered)
+EOF`
+    kill ${daemon} 2> /dev/null
+    wait ${daemon} 2> /dev/null
+    rm -f "${socket}"
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_server_builtins() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_server_builtins() $expected expected, but got $output ${NC}"
+    fi
+}
+
+assert_server_hangup() {
+    ((TESTNUM++))
+    expected="$1"
+
+    socket="/tmp/shellman-test-$$.sock"
+    touched="/tmp/shellman-test-$$.touched"
+    ${program} -d "${socket}" > /dev/null 2>&1 &
+    daemon=$!
+    sleep 0.5
+
+    # Requests sent right before a close: they are still in the socket when the daemon sees the hang-up.
+    timeout 10 python3 - "${socket}" "${touched}" <<'EOF'
+import socket, struct, sys
+lines = [b"\x01sleep 0.2", b"\x00touch " + sys.argv[2].encode()]
+client = socket.socket(socket.AF_UNIX)
+client.connect(sys.argv[1])
+client.sendall(b"".join(struct.pack(">II", len(line), tag + 1) + b"R" + line for tag, line in enumerate(lines)))
+client.close()
+EOF
+    sleep 0.5
+    [ -e "${touched}" ] && output="run" || output="dropped"
+    kill -0 ${daemon} 2> /dev/null || output="${output}, daemon dead"
+    kill ${daemon} 2> /dev/null
+    wait ${daemon} 2> /dev/null
+    rm -f "${socket}" "${touched}"
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_server_hangup() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_server_hangup() $expected expected, but got $output ${NC}"
+    fi
+}
+
+assert_monitored_copy() {
+    ((TESTNUM++))
+    expected=`wc -l < /etc/passwd`
+
+    # copy runs in a forked child of the shell, not exec'd: it must not hold the relay pipes of -m open.
+    script="/tmp/shellman-test-$$.sh"
+    echo "pipes -m cat /etc/passwd | copy | wc -l" > "${script}"
+    timeout 10 ${program} "${script}" > "${script}.out" 2> /dev/null
+    [ $? -eq 124 ] && output="hung" || output=`head -n 1 "${script}.out"`
+    pkill -f "${script}" # the forked stages and relays of a shell that hung
+    rm -f "${script}" "${script}.out"
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_monitored_copy() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_monitored_copy() $expected expected, but got $output ${NC}"
+    fi
+}
+
+assert_stdin_file() {
+    ((TESTNUM++))
+    expected="$1"
+
+    # Commands from a regular file on stdin, which epoll cannot watch: read without waiting, and exit at EOF.
+    input="/tmp/shellman-test-$$.in"
+    printf 'echo one\nsleep 0.1 &\necho two\n' > "${input}"
+    timeout 5 ${program} < "${input}" > "${input}.out" 2> /dev/null
+    [ $? -eq 124 ] && output="hung" || output=`sed 's/^shellman\$ //' "${input}.out" | grep -x -e one -e two | paste -s -d ' '`
+    rm -f "${input}" "${input}.out"
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_stdin_file() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_stdin_file() $expected expected, but got $output ${NC}"
+    fi
+}
+
+assert_script() {
+    ((TESTNUM++))
+    expected="$1"
+
+    # `shellman FILE`: no prompt, one line after another, and a summary on stderr.
+    script="/tmp/shellman-test-$$.sh"
+    printf 'echo one\nsleep 0.1 &\necho two\n' > "${script}"
+    output=`timeout 5 ${program} "${script}" 2> /dev/null | grep -x -e one -e two | paste -s -d ' '`
+    summary=`timeout 5 ${program} "${script}" 2>&1 > /dev/null | grep -o '3 commands'`
+    rm -f "${script}"
+
+    if [ "$output $summary" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_script() OK => ${output} ${summary} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_script() $expected expected, but got $output $summary ${NC}"
+    fi
+}
+
+assert_here_document() {
+    ((TESTNUM++))
+    expected="$1"
+
+    script="/tmp/shellman-test-$$.sh"
+    printf 'cat <<EOF\nhello\nhere document\nEOF\ncat <<< word\n' > "${script}"
+    output=`timeout 5 ${program} "${script}" 2> /dev/null | paste -s -d ' '`
+    rm -f "${script}"
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_here_document() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_here_document() $expected expected, but got $output ${NC}"
+    fi
+}
+
+assert_xargs_batch() {
+    ((TESTNUM++))
+    expected="$1"
+
+    # 5 items, 2 per task: one line per batch, in order with a single task at a time.
+    script="/tmp/shellman-test-$$.sh"
+    printf 'a\nb\nc\nd\ne\n' > "${script}.items"
+    printf 'xargs -P 1 -n 2 echo < %s\n' "${script}.items" > "${script}"
+    output=`timeout 5 ${program} "${script}" 2> /dev/null | grep -v '^xargs: ' | paste -s -d '|'`
+    rm -f "${script}" "${script}.items"
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_xargs_batch() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_xargs_batch() $expected expected, but got $output ${NC}"
+    fi
+}
+
+assert_parallel() {
+    ((TESTNUM++))
+    expected="$1"
+
+    # One task per item, 2 at a time: the order of their output is not fixed.
+    script="/tmp/shellman-test-$$.sh"
+    printf 'a\nb\nc\nd\ne\n' > "${script}.items"
+    printf 'parallel -j 2 echo item {} < %s\n' "${script}.items" > "${script}"
+    timeout 5 ${program} "${script}" > "${script}.out" 2> /dev/null
+    output=`grep '^item ' "${script}.out" | sort | paste -s -d ' '`
+    summary=`grep -o '^parallel: 5 tasks, 0 failed' "${script}.out"`
+    rm -f "${script}" "${script}.items" "${script}.out"
+
+    if [ "$output $summary" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_parallel() OK => ${output} ${summary} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_parallel() $expected expected, but got $output $summary ${NC}"
+    fi
+}
+
+assert_parse_cache() {
+    ((TESTNUM++))
+    expected="$1"
+
+    # The same line 3 times: parsed once, then run twice from the cache with the same result.
+    script="/tmp/shellman-test-$$.sh"
+    printf 'echo same\necho same\necho same\nparsecache\n' > "${script}"
+    output=`timeout 5 ${program} "${script}" 2> /dev/null | grep -e '^same$' -e '^hits' | paste -s -d ' '`
+    rm -f "${script}"
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_parse_cache() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_parse_cache() $expected expected, but got $output ${NC}"
+    fi
+}
+
+assert_pool_eof_tty() {
+    ((TESTNUM++))
+    expected="$1"
+
+    # In a terminal, ^D ends the items of a pool, not the shell: the next prompt still runs a line.
+    output=`timeout 10 python3 - "${program}" <<'EOF'
+import os, pty, select, sys, time
+pid, fd = pty.fork()
+if pid == 0:
+    os.execv(sys.argv[1], [sys.argv[1]])
+out = b""
+def pump(seconds):
+    global out
+    end = time.time() + seconds
+    while time.time() < end:
+        if select.select([fd], [], [], 0.05)[0]:
+            try:
+                out += os.read(fd, 4096)
+            except OSError:
+                return
+pump(0.5)
+for keys in [b"parallel -j 2 /bin/echo item {}\r", b"a\r", b"b\r", b"\x04", b"echo alive\r"]:
+    os.write(fd, keys)
+    pump(0.4)
+os.kill(pid, 9)
+lines = out.replace(b"\r", b"").split(b"\n")
+print(" ".join(line.decode() for line in lines if line in (b"item a", b"item b", b"alive")))
+EOF`
+
+    if [ "$output" = "$expected" ]; then
+        echo
+        echo -e "${GREEN}assert_pool_eof_tty() OK => ${output} ${NC}"
+        ((PASSEDCOUNTER++))
+    else
+        echo
+        echo -e "${RED}assert_pool_eof_tty() $expected expected, but got $output ${NC}"
+    fi
+}
 
 
 
@@ -220,6 +538,17 @@ assert_leftredirect 7 14
 assert_rightredirect 8 16
 assert_pipeandrightredirect 8 512
 assert_rightredirectandleftredirect 7 14
+assert_monitored_copy
+assert_stdin_file "one two"
+assert_script "one two 3 commands"
+assert_here_document "hello here document word"
+assert_xargs_batch "a b|c d|e"
+assert_parallel "item a item b item c item d item e parallel: 5 tasks, 0 failed"
+assert_parse_cache "same same same hits	2"
+assert_pool_eof_tty "item a item b alive"
+assert_server_halfclose "1 2 3 4 5"
+assert_server_builtins "2 3 1"
+assert_server_hangup "run"
 
 FAILCOUNTER=$[$TESTNUM-$PASSEDCOUNTER]
 
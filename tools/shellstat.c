@@ -0,0 +1,205 @@
+/**
+ *
+ * Reader of the metrics pages of running shells (stats.h), for monitors and
+ * fleet agents: `make tools/shellstat`, then
+ *
+ *   tools/shellstat [-j] [-i SECONDS] [PID | FILE ...]
+ *
+ * Without arguments, every page of $SHELLMAN_STATS (default /dev/shm) is read.
+ * One line per shell, or one JSON object per line with -j. -i samples again
+ * every SECONDS: the pages stay mapped, so a sample is a copy of each page and
+ * no syscall per shell. Pages left behind by shells that crashed are skipped.
+ *
+ * It needs nothing of the shell but stats.h.
+ *
+**/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../stats.h"
+
+#define MAX_PAGES 65536
+
+typedef struct page
+{
+    char filepath[512];
+    const ShellStats *stats;
+    size_t size;
+} Page;
+
+static Page pages[MAX_PAGES];
+static size_t n_pages = 0;
+
+static void map_page(const char *filepath)
+{
+    struct stat st;
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1 || n_pages == MAX_PAGES)
+    {
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(ShellStats))
+    {
+        close(fd);
+        return; // not a page, or not written yet
+    }
+
+    void *stats = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED)
+        return;
+
+    ShellStats copy;
+    if (!read_stats((const ShellStats *)stats, &copy) || (kill(copy.pid, 0) == -1 && errno == ESRCH))
+    {
+        munmap(stats, st.st_size); // another version, or left behind by a shell that crashed
+        return;
+    }
+
+    Page *page = &pages[n_pages++];
+    snprintf(page->filepath, sizeof(page->filepath), "%s", filepath);
+    page->stats = (const ShellStats *)stats;
+    page->size = st.st_size;
+}
+
+static void map_directory(const char *dir)
+{
+    DIR *dirp = opendir(dir);
+    struct dirent *entry;
+    int pid;
+    char filepath[512], tail[8];
+
+    if (dirp == NULL)
+    {
+        perror(dir);
+        return;
+    }
+    while ((entry = readdir(dirp)) != NULL)
+    {
+        if (sscanf(entry->d_name, "shellman.%d.%7s", &pid, tail) == 2 && strcmp(tail, "stats") == 0)
+        {
+            snprintf(filepath, sizeof(filepath), STATS_FILE_FORMAT, dir, pid);
+            map_page(filepath);
+        }
+    }
+    closedir(dirp);
+}
+
+// Upper bound in us of the bucket holding the given fraction of the launches, 0 if none.
+static uint64_t spawn_percentile(const ShellStats *stats, double fraction)
+{
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < SPAWN_BUCKETS; bucket++)
+    {
+        seen += stats->spawn_latency[bucket];
+        if (stats->forks > 0 && seen >= fraction * stats->forks)
+            return 1ULL << bucket;
+    }
+    return 0;
+}
+
+static void print_stats(const ShellStats *s, bool json)
+{
+    double mean_us = s->forks > 0 ? s->spawn_ns / 1e3 / s->forks : 0;
+
+    if (json)
+    {
+        printf("{\"pid\":%lld,\"started_ns\":%llu,\"updated_ns\":%llu,\"commands\":%llu,\"forks\":%llu,"
+               "\"fork_failures\":%llu,\"exec_failures\":%llu,\"reaped\":%llu,\"jobs\":{\"pending\":%llu,"
+               "\"running\":%llu,\"stopped\":%llu,\"done\":%llu,\"killed\":%llu},\"jobs_done\":%llu,"
+               "\"jobs_killed\":%llu,\"spawn_mean_us\":%.1f,\"spawn_latency_us\":{",
+               (long long)s->pid, (unsigned long long)s->started_ns, (unsigned long long)s->updated_ns,
+               (unsigned long long)s->commands, (unsigned long long)s->forks, (unsigned long long)s->fork_failures,
+               (unsigned long long)s->exec_failures, (unsigned long long)s->reaped, (unsigned long long)s->jobs[0],
+               (unsigned long long)s->jobs[1], (unsigned long long)s->jobs[2], (unsigned long long)s->jobs[3],
+               (unsigned long long)s->jobs[4], (unsigned long long)s->jobs_done,
+               (unsigned long long)s->jobs_killed, mean_us);
+        for (int bucket = 0; bucket < SPAWN_BUCKETS; bucket++)
+            printf("%s\"%s%llu\":%llu", bucket > 0 ? "," : "", bucket < SPAWN_BUCKETS - 1 ? "<" : ">=",
+                   1ULL << (bucket < SPAWN_BUCKETS - 1 ? bucket : bucket - 1),
+                   (unsigned long long)s->spawn_latency[bucket]);
+        printf("},\"arena_bytes\":%llu,\"heap_bytes\":%llu}\n", (unsigned long long)s->arena_bytes,
+               (unsigned long long)s->heap_bytes);
+        return;
+    }
+
+    printf("%-8lld %10llu %8llu %6llu %6llu %8llu %4llu %4llu %4llu %8.1f %8llu %12llu %12llu\n", (long long)s->pid,
+           (unsigned long long)s->commands, (unsigned long long)s->forks, (unsigned long long)s->fork_failures,
+           (unsigned long long)s->exec_failures, (unsigned long long)s->reaped, (unsigned long long)s->jobs[0],
+           (unsigned long long)s->jobs[1], (unsigned long long)s->jobs[2], mean_us,
+           (unsigned long long)spawn_percentile(s, 0.99), (unsigned long long)s->arena_bytes,
+           (unsigned long long)s->heap_bytes);
+}
+
+static void sample(bool json)
+{
+    ShellStats copy;
+
+    if (!json)
+        printf("%-8s %10s %8s %6s %6s %8s %4s %4s %4s %8s %8s %12s %12s\n", "pid", "commands", "forks", "forkf",
+               "execf", "reaped", "pend", "run", "stop", "spawn_us", "p99_us", "arena_bytes", "heap_bytes");
+
+    for (size_t i = 0; i < n_pages; i++)
+    {
+        if (read_stats(pages[i].stats, &copy))
+            print_stats(&copy, json);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    double interval = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ji:")) != -1)
+    {
+        if (opt == 'j')
+            json = true;
+        else if (opt == 'i' && (interval = atof(optarg)) > 0)
+            continue;
+        else
+        {
+            fprintf(stderr, "usage: %s [-j] [-i SECONDS] [PID | FILE ...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char *dir = getenv("SHELLMAN_STATS");
+    if (dir == NULL || dir[0] == '\0' || strcmp(dir, "off") == 0)
+        dir = STATS_DIR;
+
+    if (optind == argc)
+        map_directory(dir);
+    for (int i = optind; i < argc; i++)
+    {
+        char filepath[512];
+        char *end;
+        long pid = strtol(argv[i], &end, 10);
+
+        if (*end == '\0')
+            snprintf(filepath, sizeof(filepath), STATS_FILE_FORMAT, dir, (int)pid);
+        else
+            snprintf(filepath, sizeof(filepath), "%s", argv[i]);
+        map_page(filepath);
+    }
+
+    sample(json);
+    while (interval > 0)
+    {
+        struct timespec pause = {(time_t)interval, (long)((interval - (time_t)interval) * 1e9)};
+        nanosleep(&pause, NULL);
+        sample(json);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include <fcntl.h>
+#include <time.h>
+
+#include "trace.h"
+
+bool tracing = false;
+
+static int trace_fd = -1;
+static pid_t trace_pid;
+static char trace_buffer[TRACE_BUFFER_SIZE];
+static size_t trace_used = 0;
+
+#define MAX_EVENT_SIZE 512
+
+static void write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n == -1)
+            return; // a broken trace must not break the shell
+        data += n;
+        size -= n;
+    }
+}
+
+// Format one event followed by ",\n". Chrome's importer accepts the trailing comma.
+static size_t format_event(char *dest, const char *name, uint64_t start, uint64_t finish, pid_t tid,
+                           const char *detail)
+{
+    int len = snprintf(dest, MAX_EVENT_SIZE, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                       name, start / 1e3, (finish - start) / 1e3, trace_pid, tid);
+
+    if (detail != NULL)
+    {
+        len += snprintf(dest + len, MAX_EVENT_SIZE - len, ",\"args\":{\"detail\":\"");
+        for (const char *c = detail; *c != '\0' && len < MAX_EVENT_SIZE - 16; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                dest[len++] = '\\';
+            dest[len++] = (unsigned char)*c < 0x20 ? ' ' : *c;
+        }
+        len += snprintf(dest + len, MAX_EVENT_SIZE - len, "\"}");
+    }
+
+    len += snprintf(dest + len, MAX_EVENT_SIZE - len, "},\n");
+    return len;
+}
+
+void flush_trace()
+{
+    if (trace_fd == -1 || trace_used == 0)
+        return;
+
+    write_all(trace_fd, trace_buffer, trace_used);
+    trace_used = 0;
+}
+
+static void close_trace()
+{
+    char metadata[128];
+
+    if (getpid() != trace_pid)
+        return; // a child which exit()ed instead of _exit()
+
+    flush_trace();
+    int len = snprintf(metadata, sizeof(metadata),
+                       "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"shellman\"}}\n]\n", trace_pid);
+    write_all(trace_fd, metadata, len);
+    close(trace_fd);
+    trace_fd = -1;
+    tracing = false;
+}
+
+void init_trace()
+{
+    char *path = getenv("SHELLMAN_TRACE");
+
+    if (path == NULL || path[0] == '\0')
+        return;
+
+    if ((trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)) == -1)
+    {
+        perror("-shellman: SHELLMAN_TRACE");
+        return;
+    }
+
+    trace_pid = getpid();
+    write_all(trace_fd, "[\n", 2);
+    tracing = true;
+    atexit(close_trace);
+}
+
+uint64_t trace_clock()
+{
+    struct timespec now;
+
+    if (!tracing)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void trace_span(const char *name, uint64_t start, const char *detail)
+{
+    if (!tracing)
+        return;
+
+    uint64_t finish = trace_clock();
+
+    if (trace_used + MAX_EVENT_SIZE > TRACE_BUFFER_SIZE)
+        flush_trace();
+
+    trace_used += format_event(trace_buffer + trace_used, name, start, finish, trace_pid, detail);
+}
+
+void trace_child_span(const char *name, uint64_t start, const char *detail)
+{
+    char event[MAX_EVENT_SIZE];
+
+    if (!tracing)
+        return;
+
+    size_t len = format_event(event, name, start, trace_clock(), getpid(), detail);
+    write(trace_fd, event, len); // O_APPEND: lands whole between two flushes of the shell
+}
@@ -0,0 +1,44 @@
+#ifndef trace_h
+#define trace_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define TRACE_BUFFER_SIZE (64 * 1024)
+
+/**
+ *
+ * Opt-in tracing of the command lifecycle: `SHELLMAN_TRACE=/path/trace.json shellman`.
+ *
+ * Every phase of a prompt iteration (tokenize, parse, fork/setpgid/tcsetpgrp, exec
+ * in the child, each reap, free_jobs) becomes a complete ("X") event of the Chrome
+ * trace-event format, timed with CLOCK_MONOTONIC. Load the file in chrome://tracing
+ * or Perfetto.
+ *
+ * Events are formatted into a buffer which is written out when it is full, when the
+ * shell is idle at the prompt and at exit. The file is opened with O_APPEND so that
+ * a forked child can write its own event with a single write() without tearing the
+ * shell's. When tracing is off, trace_clock() returns 0 and trace_span() returns at
+ * once.
+ *
+**/
+
+extern bool tracing;
+
+// Open $SHELLMAN_TRACE if it is set. The trace is closed at exit.
+void init_trace();
+// Monotonic time in ns, or 0 if tracing is off.
+uint64_t trace_clock();
+// Record the phase name which started at start (from trace_clock()). detail may be NULL.
+void trace_span(const char *name, uint64_t start, const char *detail);
+// Record a phase of a forked child directly to the file. The shell's buffer is not touched.
+void trace_child_span(const char *name, uint64_t start, const char *detail);
+// Write out the buffered events.
+void flush_trace();
+
+#endif
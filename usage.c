@@ -0,0 +1,84 @@
+#include "usage.h"
+
+static double timespec_seconds(const struct timespec *ts)
+{
+    return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static bool timespec_is_zero(const struct timespec *ts)
+{
+    return ts->tv_sec == 0 && ts->tv_nsec == 0;
+}
+
+void start_usage(Usage *usage)
+{
+    clock_gettime(CLOCK_MONOTONIC, &usage->start);
+}
+
+void end_usage(Usage *usage, const struct rusage *rusage)
+{
+    clock_gettime(CLOCK_MONOTONIC, &usage->end);
+    usage->utime = rusage->ru_utime;
+    usage->stime = rusage->ru_stime;
+    usage->maxrss = rusage->ru_maxrss;
+    usage->nvcsw = rusage->ru_nvcsw;
+    usage->nivcsw = rusage->ru_nivcsw;
+}
+
+void add_usage(Usage *total, const Usage *part)
+{
+    if (timespec_is_zero(&total->start) || timespec_seconds(&part->start) < timespec_seconds(&total->start))
+        total->start = part->start;
+    if (timespec_seconds(&part->end) > timespec_seconds(&total->end))
+        total->end = part->end;
+
+    timeradd(&total->utime, &part->utime, &total->utime);
+    timeradd(&total->stime, &part->stime, &total->stime);
+    if (part->maxrss > total->maxrss)
+        total->maxrss = part->maxrss;
+    total->nvcsw += part->nvcsw;
+    total->nivcsw += part->nivcsw;
+}
+
+void diff_usage(Usage *usage, const struct rusage *before, const struct rusage *after)
+{
+    clock_gettime(CLOCK_MONOTONIC, &usage->end);
+    timersub(&after->ru_utime, &before->ru_utime, &usage->utime);
+    timersub(&after->ru_stime, &before->ru_stime, &usage->stime);
+    usage->maxrss = after->ru_maxrss; // a high-water mark, not a counter
+    usage->nvcsw = after->ru_nvcsw - before->ru_nvcsw;
+    usage->nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+}
+
+uint64_t spawn_latency_ns(const Usage *usage)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - usage->start.tv_sec) * 1000000000 + now.tv_nsec - usage->start.tv_nsec;
+}
+
+double wall_seconds(const Usage *usage)
+{
+    struct timespec now;
+
+    if (timespec_is_zero(&usage->start))
+        return 0.0;
+
+    if (!timespec_is_zero(&usage->end))
+        return timespec_seconds(&usage->end) - timespec_seconds(&usage->start);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_seconds(&now) - timespec_seconds(&usage->start);
+}
+
+void print_usage(FILE *stream, const Usage *usage)
+{
+    fprintf(stream, "real %.3fs user %.3fs sys %.3fs maxrss %ldKiB csw %ld/%ld",
+            wall_seconds(usage), timeval_seconds(&usage->utime), timeval_seconds(&usage->stime),
+            usage->maxrss, usage->nvcsw, usage->nivcsw);
+}
@@ -0,0 +1,47 @@
+#ifndef usage_h
+#define usage_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+/**
+ *
+ * Resource usage of a process, or the sum over the processes of a job.
+ *
+ * Wall time runs from just before the process is spawned until it is reaped.
+ * CPU time, max RSS and context switches come from the rusage wait4() returns
+ * with the exit status. For a job, CPU time and context switches are summed over
+ * its processes, max RSS is the largest of them and the wall time spans from the
+ * first spawn to the last exit.
+ *
+**/
+typedef struct usage
+{
+    struct timespec start; // zero if not started
+    struct timespec end;   // zero while running
+    struct timeval utime;
+    struct timeval stime;
+    long maxrss; // KiB
+    long nvcsw;  // voluntary context switches
+    long nivcsw; // involuntary context switches
+} Usage;
+
+void start_usage(Usage *usage);
+// Record the rusage of a terminated process.
+void end_usage(Usage *usage, const struct rusage *rusage);
+// Fold the usage of a terminated process into the usage of its job.
+void add_usage(Usage *total, const Usage *part);
+// Record what a builtin cost the shell and the children it reaped between two getrusage() samples.
+void diff_usage(Usage *usage, const struct rusage *before, const struct rusage *after);
+// Nanoseconds since start_usage(): how long a launch took, right after it.
+uint64_t spawn_latency_ns(const Usage *usage);
+// Wall time in seconds; up to now if still running.
+double wall_seconds(const Usage *usage);
+// "real 0.302s user 0.001s sys 0.000s maxrss 1824KiB csw 2/0"
+void print_usage(FILE *stream, const Usage *usage);
+
+#endif
@@ -20,6 +20,10 @@ void set_ignore()
 void set_default()
 {
     struct sigaction sact;
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL); // the shell blocks SIGCHLD for its signalfd
 
     sigemptyset(&sact.sa_mask);
     sact.sa_flags = SA_RESTART;
@@ -34,19 +38,23 @@ void set_default()
     sigaction(SIGTSTP, &sact, NULL);
 }
 
-void free_string(char *string)
+bool is_builtin(const char *cmd, size_t size)
 {
-    if (string != NULL)
-        free(string);
-
-    string = NULL;
+    for (size_t i = 0; i < n_builtins; i++)
+    {
+        if (strncmp(cmd, builtins[i], size) == 0 && builtins[i][size] == '\0')
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
-bool is_builtin(char *cmd)
+bool is_stage_builtin(const char *cmd)
 {
-    for (size_t i = 0; i < n_builtins; i++)
+    for (size_t i = 0; i < n_stage_builtins; i++)
     {
-        if (strcmp(cmd, builtins[i]) == 0)
+        if (strcmp(cmd, stage_builtins[i]) == 0)
         {
             return true;
         }
@@ -9,12 +9,17 @@
 #include <unistd.h>
 
 static const char *builtins[] = {
-    "jobs", "fg", "bg"};
+    "jobs", "fg", "bg", "hash", "spawn", "parallel", "xargs", "history", "parsecache", "bench", "pipes", "place", "admit", "shellstat"};
 static const size_t n_builtins = sizeof(builtins) / sizeof(char *);
 
+// Builtins that run as a stage of a pipeline, in a forked child without exec.
+static const char *stage_builtins[] = {
+    "copy"};
+static const size_t n_stage_builtins = sizeof(stage_builtins) / sizeof(char *);
+
 void set_ignore();
 void set_default();
-void free_string(char *string);
-bool is_builtin(char *cmd);
+bool is_builtin(const char *cmd, size_t size);
+bool is_stage_builtin(const char *cmd);
 
 #endif